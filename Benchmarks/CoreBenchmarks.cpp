@@ -0,0 +1,124 @@
+﻿#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "SnowyCore.hpp"
+#include "Source/EnumFlags.hpp"
+
+using namespace Snowy;
+
+// Usage: CoreBenchmarks [results.json]
+namespace
+{
+enum class BenchBit : uint32_t
+{
+    A = 1 << 0,
+    B = 1 << 3,
+    C = 1 << 7,
+    D = 1 << 12,
+    E = 1u << 31,
+};
+}
+template<> struct Snowy::FlagTraits<BenchBit>
+{
+    static constexpr bool IsBitmask = true;
+    static constexpr Flags<BenchBit> AllFlags = BenchBit::A | BenchBit::B | BenchBit::C | BenchBit::D | BenchBit::E;
+};
+
+namespace
+{
+struct Payload
+{
+    uint64_t Value = 0;
+};
+
+void AddStringBenchmarks(BenchmarkSuite& suite)
+{
+    static const AnsiString ansi(256, 'a');
+    static const WideString wide(256, L'w');
+    static const AnsiString utf8 = UTF8_TEXT("SnowyCore 雪 ✓ ") + AnsiString(240, 'x');
+    static const Utf16String utf16 = utf8::utf8to16(utf8);
+
+    suite.Add("StringConvertor::WideToAnsi/256", [] { DoNotOptimize(StringConvertor::WideToAnsi(wide)); });
+    suite.Add("StringConvertor::AnsiToWide/256", [] { DoNotOptimize(StringConvertor::AnsiToWide(ansi)); });
+    suite.Add("StringConvertor::WideToUtf8/256", [] { DoNotOptimize(StringConvertor::WideToUtf8(wide)); });
+    suite.Add("utf8::is_valid/256", [] { DoNotOptimize(utf8::is_valid(utf8)); });
+    suite.Add("utf8::utf8to16/256", [] { DoNotOptimize(utf8::utf8to16(utf8)); });
+    suite.Add("utf8::utf16to8/256", [] { DoNotOptimize(utf8::utf16to8(utf16)); });
+}
+
+void AddFlagsBenchmarks(BenchmarkSuite& suite)
+{
+    suite.Add("Flags::Combine", [](uint64_t iterations) {
+        Flags<BenchBit> flags;
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            flags |= (i & 1) ? BenchBit::A | BenchBit::C : BenchBit::B | BenchBit::E;
+            flags &= ~Flags<BenchBit>(BenchBit::D);
+            DoNotOptimize(flags);
+        }
+    });
+    suite.Add("Flags::HasAll+Count", [](uint64_t iterations) {
+        Flags<BenchBit> flags = BenchBit::A | BenchBit::C | BenchBit::E;
+        int total = 0;
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            DoNotOptimize(flags);
+            total += flags.HasAll(BenchBit::A | BenchBit::E) ? flags.Count() : 0;
+        }
+        DoNotOptimize(total);
+    });
+    suite.Add("Flags::Iterate", [](uint64_t iterations) {
+        Flags<BenchBit> flags = BenchBit::A | BenchBit::B | BenchBit::C | BenchBit::D | BenchBit::E;
+        uint32_t total = 0;
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            DoNotOptimize(flags);
+            for (BenchBit bit : flags)
+            {
+                total += static_cast<uint32_t>(bit);
+            }
+        }
+        DoNotOptimize(total);
+    });
+}
+
+void AddHandleBenchmarks(BenchmarkSuite& suite)
+{
+    suite.Add("UniqueHandle::MakeUnique", [] { DoNotOptimize(MakeUnique<Payload>()); });
+    suite.Add("SharedHandle::MakeShared", [] { DoNotOptimize(MakeShared<Payload>()); });
+    static const SharedHandle<Payload> shared = MakeShared<Payload>();
+    suite.Add("SharedHandle::Copy", [] {
+        SharedHandle<Payload> copy = shared;
+        DoNotOptimize(copy);
+    });
+    static const WeakHandle<Payload> weak = shared;
+    suite.Add("WeakHandle::Lock", [] { DoNotOptimize(weak.lock()); });
+    suite.Add("ObserverHandle::Deref", [](uint64_t iterations) {
+        Payload payload;
+        ObserverHandle<Payload> observer = MakeObserver<Payload>(&payload);
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+            DoNotOptimize(observer);
+            observer->Value += i;
+        }
+        DoNotOptimize(payload.Value);
+    });
+}
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkSuite suite("SnowyCore");
+    AddStringBenchmarks(suite);
+    AddFlagsBenchmarks(suite);
+    AddHandleBenchmarks(suite);
+    suite.Run();
+    suite.WriteTable(std::cout);
+    if (argc > 1)
+    {
+        std::ofstream json(argv[1]);
+        suite.WriteJson(json);
+    }
+    return 0;
+}
@@ -0,0 +1,129 @@
+﻿#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SnowyCore.hpp"
+
+using namespace Snowy;
+
+// Usage: QueueBenchmarks [results.json]
+// Contention of TMpmcQueue against a mutex + condition variable queue of the same capacity, at 1 to 64 threads.
+// Half the threads produce and half consume, a single thread alternates push and pop.
+namespace
+{
+constexpr size_t g_QueueCapacity = 1024;
+
+class MutexQueue
+{
+private:
+    std::mutex m_Mutex;
+    std::condition_variable m_NotEmpty;
+    std::condition_variable m_NotFull;
+    std::deque<uint64_t> m_Items;
+
+public:
+    void Push(uint64_t value)
+    {
+        std::unique_lock lock(m_Mutex);
+        m_NotFull.wait(lock, [&] { return m_Items.size() < g_QueueCapacity; });
+        m_Items.push_back(value);
+        lock.unlock();
+        m_NotEmpty.notify_one();
+    }
+    uint64_t Pop()
+    {
+        std::unique_lock lock(m_Mutex);
+        m_NotEmpty.wait(lock, [&] { return !m_Items.empty(); });
+        uint64_t value = m_Items.front();
+        m_Items.pop_front();
+        lock.unlock();
+        m_NotFull.notify_one();
+        return value;
+    }
+};
+
+// Share of count for worker index out of workers, the first ones take the remainder.
+uint64_t ShareOf(uint64_t count, uint32_t workers, uint32_t index)
+{
+    return count / workers + (index < count % workers ? 1 : 0);
+}
+
+template<typename Queue>
+void RunContention(uint32_t threads, uint64_t items)
+{
+    Queue queue;
+    if (threads == 1)
+    {
+        for (uint64_t i = 0; i < items; ++i)
+        {
+            queue.Push(i);
+            DoNotOptimize(queue.Pop());
+        }
+        return;
+    }
+    uint32_t producers = threads / 2;
+    uint32_t consumers = threads - producers;
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for (uint32_t i = 0; i < producers; ++i)
+    {
+        workers.emplace_back([&queue, count = ShareOf(items, producers, i)] {
+            for (uint64_t n = 0; n < count; ++n)
+            {
+                queue.Push(n);
+            }
+        });
+    }
+    for (uint32_t i = 0; i < consumers; ++i)
+    {
+        workers.emplace_back([&queue, count = ShareOf(items, consumers, i)] {
+            uint64_t sum = 0;
+            for (uint64_t n = 0; n < count; ++n)
+            {
+                sum += queue.Pop();
+            }
+            DoNotOptimize(sum);
+        });
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+struct MpmcQueue : TMpmcQueue<uint64_t>
+{
+    MpmcQueue() : TMpmcQueue<uint64_t>(g_QueueCapacity) {}
+};
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkSuite suite("Queue contention, ns per item");
+    for (uint32_t threads = 1; threads <= 64; threads *= 2)
+    {
+        std::string suffix = "/" + std::to_string(threads) + " threads";
+        suite.Add("TMpmcQueue" + suffix, [threads](uint64_t items) { RunContention<MpmcQueue>(threads, items); });
+        suite.Add("MutexQueue" + suffix, [threads](uint64_t items) { RunContention<MutexQueue>(threads, items); });
+    }
+
+    // Every batch starts its threads, so let batches grow large enough to hide that.
+    BenchmarkDesc desc;
+    desc.WarmupTime = std::chrono::milliseconds(50);
+    desc.SampleTime = std::chrono::milliseconds(50);
+    desc.SampleCount = 15;
+    desc.MinIterations = 1024;
+    suite.Run(desc);
+    suite.WriteTable(std::cout);
+    if (argc > 1)
+    {
+        std::ofstream json(argv[1]);
+        suite.WriteJson(json);
+    }
+    return 0;
+}
@@ -3,4 +3,25 @@
 #include "Source/Typedef.hpp"
 #include "Source/Singleton.hpp"
 #include "Source/String.hpp"
-#include "Source/Misc.hpp"
\ No newline at end of file
+#include "Source/Misc.hpp"
+#include "Source/EnumReflect.hpp"
+#include "Source/SmallVector.hpp"
+#include "Source/SpscQueue.hpp"
+#include "Source/MpmcQueue.hpp"
+#include "Source/SparseSet.hpp"
+#include "Source/SoAVector.hpp"
+#include "Source/FlatMap.hpp"
+#include "Source/ThreadPool.hpp"
+#include "Source/Coroutine.hpp"
+#include "Source/TaskGraph.hpp"
+#include "Source/Parallel.hpp"
+#include "Source/Lock.hpp"
+#include "Source/TimerWheel.hpp"
+#include "Source/Reclamation.hpp"
+#include "Source/ShardedCounter.hpp"
+#include "Source/Profiler.hpp"
+#include "Source/Benchmark.hpp"
+#include "Source/Metrics.hpp"
+#include "Source/Logger.hpp"
+#include "Source/AsyncIO.hpp"
+#include "Source/Serialization.hpp"
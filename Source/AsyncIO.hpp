@@ -0,0 +1,550 @@
+﻿#pragma once
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Platform.hpp"
+#include "Typedef.hpp"
+#include "Misc.hpp"
+#include "ThreadPool.hpp"
+#include "Lock.hpp"
+
+namespace Snowy
+{
+struct AsyncIODesc
+{
+    // Threads waiting on the completion port, callbacks and resumed coroutines run on them.
+    uint32_t CompletionThreads = 1;
+    // Completions dequeued per wake-up.
+    uint32_t CompletionBatch = 64;
+    // Use the blocking fallback even when the completion port is available.
+    bool ForceFallback = false;
+    // Runs the blocking reads and writes of the fallback, nullptr uses GlobalThreadPool.
+    ThreadPool* FallbackPool = nullptr;
+};
+
+struct AsyncFileDesc
+{
+    MappedFileAccess Access = MappedFileAccess::Read;
+    // Transfer straight between the device and the caller's buffer, bypassing the page cache.
+    // Offsets, sizes and buffer addresses must then be multiples of the volume sector size.
+    bool Unbuffered = false;
+    // Writes complete only once they reached the device.
+    bool WriteThrough = false;
+};
+
+struct IOResult
+{
+    uint64_t Bytes = 0;
+    uint32_t Error = 0;     // system error code, 0 on success; reading at or past the end is a success of 0 bytes
+
+    bool Succeeded() const noexcept { return Error == 0; }
+};
+
+using IOCallback = std::function<void(In<IOResult>)>;
+
+/// <summary>
+/// File handle opened through an AsyncIO, which it must not outlive.
+/// </summary>
+class AsyncFile
+{
+    friend class AsyncIO;
+
+private:
+#if defined(_WIN32)
+    HANDLE m_Handle = INVALID_HANDLE_VALUE;
+#endif
+    // Requests served from the cache complete inline instead of through the port.
+    bool m_InlineCompletion = false;
+
+public:
+    AsyncFile() = default;
+    ~AsyncFile() { Close(); }
+    AsyncFile(const AsyncFile&) = delete;
+    AsyncFile& operator=(const AsyncFile&) = delete;
+    AsyncFile(AsyncFile&& other) noexcept
+    {
+        std::swap(m_Handle, other.m_Handle);
+        std::swap(m_InlineCompletion, other.m_InlineCompletion);
+    }
+    AsyncFile& operator=(AsyncFile&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Close();
+            std::swap(m_Handle, other.m_Handle);
+            std::swap(m_InlineCompletion, other.m_InlineCompletion);
+        }
+        return *this;
+    }
+
+    bool IsOpen() const noexcept
+    {
+    #if defined(_WIN32)
+        return m_Handle != INVALID_HANDLE_VALUE;
+    #else
+        #error "Platform is not support!"
+    #endif
+    }
+
+    uint64_t Size() const noexcept
+    {
+    #if defined(_WIN32)
+        LARGE_INTEGER size{};
+        return IsOpen() && GetFileSizeEx(m_Handle, &size) ? uint64_t(size.QuadPart) : 0;
+    #else
+        #error "Platform is not support!"
+    #endif
+    }
+
+    /// <summary>
+    /// Close the file. Requests still in flight must have completed.
+    /// </summary>
+    void Close() noexcept
+    {
+    #if defined(_WIN32)
+        if (m_Handle != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_Handle);
+            m_Handle = INVALID_HANDLE_VALUE;
+        }
+    #else
+        #error "Platform is not support!"
+    #endif
+    }
+};
+
+/// <summary>
+/// Asynchronous positional file reads and writes. Requests are overlapped I/O on a completion port, drained in batches by
+/// a few completion threads, and finish through a callback or by resuming the coroutine that awaited them.
+/// Where the port can't be created the same API runs blocking positional I/O on a thread pool.
+/// </summary>
+class AsyncIO
+{
+private:
+    struct Operation;
+
+#if defined(_WIN32)
+    // Standard layout so the OVERLAPPED handed back by the port leads back to its operation.
+    struct OverlappedLink
+    {
+        OVERLAPPED Overlapped;
+        Operation* Owner;
+    };
+#endif
+
+    struct Operation final : ThreadJob
+    {
+    #if defined(_WIN32)
+        OverlappedLink Link{};
+        HANDLE File = INVALID_HANDLE_VALUE;
+    #endif
+        AsyncIO* Engine = nullptr;
+        bool Write = false;
+        bool InlineCompletion = false;
+        uint64_t Offset = 0;
+        std::byte* Buffer = nullptr;
+        uint32_t Size = 0;
+        IOCallback Callback;
+        std::coroutine_handle<> Continuation;
+        IOResult* ResultOut = nullptr;
+
+        // Fallback path, runs on the pool.
+        void Execute() noexcept override { Engine->Complete(*this, Engine->TransferBlocking(*this), false); }
+    };
+
+    static constexpr uintptr_t s_StopKey = 1;
+    static constexpr size_t s_MaxRequestSize = UINT32_MAX;
+
+    AsyncIODesc m_Desc;
+    bool m_Fallback = false;
+#if defined(_WIN32)
+    HANDLE m_Port = nullptr;
+#endif
+    std::vector<std::thread> m_Threads;
+    SpinLock m_FreeLock;
+    std::vector<Operation*> m_FreeOperations;
+    alignas(g_CacheLineSize) std::atomic<uint64_t> m_InFlight{ 0 };
+    // Completions between their m_InFlight decrement and their last access to the engine, the destructor waits them out.
+    std::atomic<uint32_t> m_Exiting{ 0 };
+
+public:
+    /// <summary>
+    /// Awaitable request, co_await yields the IOResult. The coroutine resumes on a completion or pool thread,
+    /// or inline if the request completed right away. Nothing is issued until it is awaited.
+    /// </summary>
+    class [[nodiscard]] IOAwaiter
+    {
+        friend class AsyncIO;
+
+    private:
+        AsyncIO* m_Engine;
+        AsyncFile* m_File;
+        uint64_t m_Offset;
+        std::byte* m_Buffer;
+        size_t m_Size;
+        bool m_Write;
+        IOResult m_Result;
+
+        IOAwaiter(AsyncIO& engine, AsyncFile& file, uint64_t offset, std::byte* buffer, size_t size, bool write) noexcept
+            : m_Engine(&engine), m_File(&file), m_Offset(offset), m_Buffer(buffer), m_Size(size), m_Write(write)
+        {
+        }
+
+    public:
+        bool await_ready() noexcept
+        {
+            if (m_Size > s_MaxRequestSize) [[unlikely]]
+            {
+                m_Result = InvalidRequest();
+                return true;
+            }
+            return false;
+        }
+        bool await_suspend(std::coroutine_handle<> continuation)
+        {
+            Operation& operation = m_Engine->Acquire(*m_File, m_Offset, m_Buffer, m_Size, m_Write);
+            operation.Continuation = continuation;
+            operation.ResultOut = &m_Result;
+            // Once submitted, the continuation may already be running, don't touch this.
+            return !m_Engine->Submit(operation);
+        }
+        IOResult await_resume() const noexcept { return m_Result; }
+    };
+
+    explicit AsyncIO(In<AsyncIODesc> desc = {}) : m_Desc(desc)
+    {
+    #if defined(_WIN32)
+        if (!desc.ForceFallback)
+        {
+            m_Port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, desc.CompletionThreads);
+        }
+        m_Fallback = m_Port == nullptr;
+    #else
+        #error "Platform is not support!"
+    #endif
+        if (!m_Fallback)
+        {
+            for (uint32_t i = 0; i < std::max(desc.CompletionThreads, 1u); ++i)
+            {
+                m_Threads.emplace_back([this] { CompletionLoop(); });
+            }
+        }
+    }
+    AsyncIO(const AsyncIO&) = delete;
+    AsyncIO& operator=(const AsyncIO&) = delete;
+
+    /// <summary>
+    /// Waits for every request in flight to complete and its callback or continuation to return, so don't destroy the
+    /// engine from inside one.
+    /// </summary>
+    ~AsyncIO()
+    {
+        for (uint64_t inFlight = m_InFlight.load(std::memory_order_acquire); inFlight != 0;
+             inFlight = m_InFlight.load(std::memory_order_acquire))
+        {
+            m_InFlight.wait(inFlight, std::memory_order_acquire);
+        }
+        while (m_Exiting.load(std::memory_order_acquire) != 0)
+        {
+            Platform::CpuPause();
+        }
+    #if defined(_WIN32)
+        for (size_t i = 0; i < m_Threads.size(); ++i)
+        {
+            PostQueuedCompletionStatus(m_Port, 0, s_StopKey, nullptr);
+        }
+        for (std::thread& thread : m_Threads)
+        {
+            thread.join();
+        }
+        if (m_Port != nullptr)
+        {
+            CloseHandle(m_Port);
+        }
+    #else
+        #error "Platform is not support!"
+    #endif
+        for (Operation* operation : m_FreeOperations)
+        {
+            delete operation;
+        }
+    }
+
+    bool IsFallback() const noexcept { return m_Fallback; }
+
+    bool Open(AsyncFile& file, const std::filesystem::path& path, In<AsyncFileDesc> desc = {})
+    {
+    #if defined(_WIN32)
+        file.Close();
+        bool write = desc.Access == MappedFileAccess::ReadWrite;
+        DWORD flags = FILE_ATTRIBUTE_NORMAL;
+        flags |= m_Fallback ? 0 : FILE_FLAG_OVERLAPPED;
+        flags |= desc.Unbuffered ? FILE_FLAG_NO_BUFFERING : 0;
+        flags |= desc.WriteThrough ? FILE_FLAG_WRITE_THROUGH : 0;
+        HANDLE handle = CreateFileW(path.c_str(), write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ,
+                                    nullptr, write ? OPEN_ALWAYS : OPEN_EXISTING, flags, nullptr);
+        if (handle == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        if (!m_Fallback)
+        {
+            if (CreateIoCompletionPort(handle, m_Port, 0, 0) == nullptr)
+            {
+                CloseHandle(handle);
+                return false;
+            }
+            file.m_InlineCompletion = SetFileCompletionNotificationModes(handle, FILE_SKIP_COMPLETION_PORT_ON_SUCCESS | FILE_SKIP_SET_EVENT_ON_HANDLE) != 0;
+        }
+        file.m_Handle = handle;
+        return true;
+    #else
+        #error "Platform is not support!"
+    #endif
+    }
+
+    // -------------------------------------------------------------
+    // Callbacks
+    // -------------------------------------------------------------
+
+    /// <summary>
+    /// Read into buffer at offset, callback runs once the request finished, possibly before Read returns.
+    /// buffer must stay alive until then. A request over 4 GiB fails with an invalid parameter error.
+    /// </summary>
+    void Read(AsyncFile& file, uint64_t offset, std::span<std::byte> buffer, IOCallback callback)
+    {
+        Request(file, offset, buffer.data(), buffer.size(), false, std::move(callback));
+    }
+    void Write(AsyncFile& file, uint64_t offset, ArrayIn<std::byte> data, IOCallback callback)
+    {
+        Request(file, offset, const_cast<std::byte*>(data.data()), data.size(), true, std::move(callback));
+    }
+
+    // -------------------------------------------------------------
+    // Coroutines
+    // -------------------------------------------------------------
+
+    IOAwaiter ReadAsync(AsyncFile& file, uint64_t offset, std::span<std::byte> buffer)
+    {
+        return IOAwaiter(*this, file, offset, buffer.data(), buffer.size(), false);
+    }
+    IOAwaiter WriteAsync(AsyncFile& file, uint64_t offset, ArrayIn<std::byte> data)
+    {
+        return IOAwaiter(*this, file, offset, const_cast<std::byte*>(data.data()), data.size(), true);
+    }
+
+private:
+    static IOResult InvalidRequest() noexcept
+    {
+    #if defined(_WIN32)
+        return { 0, ERROR_INVALID_PARAMETER };
+    #else
+        #error "Platform is not support!"
+    #endif
+    }
+
+    void Request(AsyncFile& file, uint64_t offset, std::byte* buffer, size_t size, bool write, IOCallback callback)
+    {
+        if (size > s_MaxRequestSize) [[unlikely]]
+        {
+            callback(InvalidRequest());
+            return;
+        }
+        Operation& operation = Acquire(file, offset, buffer, size, write);
+        operation.Callback = std::move(callback);
+        Submit(operation);
+    }
+
+    // Counts the request as in flight, so only call it right before Submit.
+    Operation& Acquire(AsyncFile& file, uint64_t offset, std::byte* buffer, size_t size, bool write)
+    {
+        SAssert(file.IsOpen());
+        SAssert(size <= s_MaxRequestSize);
+        Operation* operation = nullptr;
+        {
+            std::lock_guard lock(m_FreeLock);
+            if (!m_FreeOperations.empty())
+            {
+                operation = m_FreeOperations.back();
+                m_FreeOperations.pop_back();
+            }
+        }
+        if (operation == nullptr)
+        {
+            operation = new Operation();
+            operation->Engine = this;
+        }
+    #if defined(_WIN32)
+        operation->Link = {};
+        operation->Link.Owner = operation;
+        operation->Link.Overlapped.Offset = DWORD(offset);
+        operation->Link.Overlapped.OffsetHigh = DWORD(offset >> 32);
+        operation->File = file.m_Handle;
+    #endif
+        operation->InlineCompletion = file.m_InlineCompletion;
+        operation->Write = write;
+        operation->Offset = offset;
+        operation->Buffer = buffer;
+        operation->Size = uint32_t(size);
+        m_InFlight.fetch_add(1, std::memory_order_relaxed);
+        return *operation;
+    }
+
+    void Recycle(Operation& operation)
+    {
+        operation.Callback = nullptr;
+        operation.Continuation = nullptr;
+        operation.ResultOut = nullptr;
+        std::lock_guard lock(m_FreeLock);
+        m_FreeOperations.push_back(&operation);
+    }
+
+    // The destructor may return once m_InFlight hits zero, leaving m_Exiting is the last access to the engine.
+    void Finish() noexcept
+    {
+        m_Exiting.fetch_add(1, std::memory_order_relaxed);
+        if (m_InFlight.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            m_InFlight.notify_all();
+        }
+        m_Exiting.fetch_sub(1, std::memory_order_release);
+    }
+
+    // Start the request, returns true if it already completed on this thread.
+    bool Submit(Operation& operation)
+    {
+        if (m_Fallback)
+        {
+            ParallelPool().Schedule(&operation);
+            return false;
+        }
+    #if defined(_WIN32)
+        // Once the request is queued a completion thread may finish and recycle the operation, read it up front.
+        HANDLE file = operation.File;
+        bool write = operation.Write;
+        bool inlineCompletion = operation.InlineCompletion;
+        BOOL done = write
+            ? WriteFile(file, operation.Buffer, operation.Size, nullptr, &operation.Link.Overlapped)
+            : ReadFile(file, operation.Buffer, operation.Size, nullptr, &operation.Link.Overlapped);
+        if (done && !inlineCompletion)
+        {
+            return false;
+        }
+        if (!done && GetLastError() == ERROR_IO_PENDING)
+        {
+            return false;
+        }
+        Complete(operation, OverlappedResult(operation), true);
+        return true;
+    #else
+        #error "Platform is not support!"
+    #endif
+    }
+
+    // Callbacks run here, continuations are resumed unless the request completed inside await_suspend.
+    // The operation is recycled first, so the callback can issue the next request, and the request only stops
+    // counting as in flight after the callback returned.
+    void Complete(Operation& operation, IOResult result, bool inlineCompletion)
+    {
+        if (operation.Continuation)
+        {
+            *operation.ResultOut = result;
+            std::coroutine_handle<> continuation = operation.Continuation;
+            Recycle(operation);
+            if (!inlineCompletion)
+            {
+                continuation.resume();
+            }
+            Finish();
+            return;
+        }
+        IOCallback callback = std::move(operation.Callback);
+        Recycle(operation);
+        callback(result);
+        Finish();
+    }
+
+    ThreadPool& ParallelPool() const
+    {
+        return m_Desc.FallbackPool != nullptr ? *m_Desc.FallbackPool : GlobalThreadPool::GetInstance();
+    }
+
+#if defined(_WIN32)
+    static IOResult OverlappedResult(Operation& operation)
+    {
+        DWORD bytes = 0;
+        if (GetOverlappedResult(operation.File, &operation.Link.Overlapped, &bytes, FALSE))
+        {
+            return { bytes, 0 };
+        }
+        DWORD error = GetLastError();
+        return { bytes, error == ERROR_HANDLE_EOF ? 0u : uint32_t(error) };
+    }
+#endif
+
+    // Positional transfer on a handle opened without overlapped I/O, the pread / pwrite of the fallback.
+    static IOResult TransferBlocking(Operation& operation)
+    {
+    #if defined(_WIN32)
+        DWORD bytes = 0;
+        BOOL done = operation.Write
+            ? WriteFile(operation.File, operation.Buffer, operation.Size, &bytes, &operation.Link.Overlapped)
+            : ReadFile(operation.File, operation.Buffer, operation.Size, &bytes, &operation.Link.Overlapped);
+        if (done)
+        {
+            return { bytes, 0 };
+        }
+        DWORD error = GetLastError();
+        return { bytes, error == ERROR_HANDLE_EOF ? 0u : uint32_t(error) };
+    #else
+        #error "Platform is not support!"
+    #endif
+    }
+
+    void CompletionLoop()
+    {
+    #if defined(_WIN32)
+        std::vector<OVERLAPPED_ENTRY> entries(std::max(m_Desc.CompletionBatch, 1u));
+        for (;;)
+        {
+            ULONG count = 0;
+            if (!GetQueuedCompletionStatusEx(m_Port, entries.data(), ULONG(entries.size()), &count, INFINITE, FALSE))
+            {
+                continue;
+            }
+            uint32_t stops = 0;
+            for (ULONG i = 0; i < count; ++i)
+            {
+                if (entries[i].lpCompletionKey == s_StopKey)
+                {
+                    ++stops;
+                    continue;
+                }
+                Operation& operation = *reinterpret_cast<OverlappedLink*>(entries[i].lpOverlapped)->Owner;
+                Complete(operation, OverlappedResult(operation), false);
+            }
+            if (stops != 0)
+            {
+                // One stop is ours, hand the others on to the threads they were meant for.
+                for (uint32_t i = 1; i < stops; ++i)
+                {
+                    PostQueuedCompletionStatus(m_Port, 0, s_StopKey, nullptr);
+                }
+                return;
+            }
+        }
+    #else
+        #error "Platform is not support!"
+    #endif
+    }
+};
+}
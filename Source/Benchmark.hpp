@@ -0,0 +1,272 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+
+namespace Snowy
+{
+struct BenchmarkDesc
+{
+    // Time spent running the body before measuring, also used to pick the iteration count.
+    std::chrono::nanoseconds WarmupTime = std::chrono::milliseconds(100);
+    // Target length of one sample, iterations per sample are scaled to reach it.
+    std::chrono::nanoseconds SampleTime = std::chrono::milliseconds(10);
+    uint32_t SampleCount = 31;
+    uint64_t MinIterations = 1;
+    uint64_t MaxIterations = uint64_t(1) << 32;
+};
+
+struct BenchmarkResult
+{
+    std::string Name;
+    uint64_t Iterations = 0;            // per sample
+    std::vector<double> Samples;        // nanoseconds per iteration, sorted
+    double Median = 0.0;
+    double Mad = 0.0;                   // median absolute deviation from the median
+    double Mean = 0.0;
+    double Min = 0.0;
+    double Max = 0.0;
+    double P90 = 0.0;
+    double P99 = 0.0;
+    double Cycles = 0.0;                // median time stamp counter ticks per iteration
+    double ThreadCycles = 0.0;          // median cpu cycles charged to the thread per iteration
+
+    // Median absolute deviation relative to the median, a robust noise estimate.
+    double RelativeMad() const noexcept { return Median != 0.0 ? Mad / Median : 0.0; }
+};
+
+namespace Detail
+{
+inline const volatile void* volatile g_BenchmarkSink = nullptr;
+
+// Linear interpolation between the closest ranks, sorted must not be empty.
+inline double Percentile(ArrayIn<double> sorted, double fraction) noexcept
+{
+    double rank = fraction * double(sorted.size() - 1);
+    size_t lower = size_t(rank);
+    size_t upper = std::min(lower + 1, sorted.size() - 1);
+    return sorted[lower] + (sorted[upper] - sorted[lower]) * (rank - double(lower));
+}
+
+inline double Median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return Percentile(values, 0.5);
+}
+}
+
+/// <summary>
+/// Keep value and everything it depends on from being optimized away, without the cost of a real side effect.
+/// </summary>
+template<typename T>
+inline void DoNotOptimize(const T& value) noexcept
+{
+    Detail::g_BenchmarkSink = static_cast<const volatile void*>(std::addressof(value));
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+}
+/// <summary>
+/// Make the compiler assume all memory was read and written here, e.g. after a body that only writes memory.
+/// </summary>
+inline void ClobberMemory() noexcept
+{
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+}
+
+/// <summary>
+/// Measure body with warm-up and auto-scaled iterations and summarize the samples with robust statistics.
+/// body is either fn() for one iteration, or fn(uint64_t iterations) running a whole batch, for bodies that need
+/// per-batch setup or want to keep the loop overhead themselves.
+/// </summary>
+template<typename Fn>
+BenchmarkResult RunBenchmark(AnsiStringIn name, Fn&& body, In<BenchmarkDesc> desc = {})
+{
+    using Clock = std::chrono::steady_clock;
+    auto runBatch = [&](uint64_t iterations) {
+        if constexpr (std::is_invocable_v<Fn&, uint64_t>)
+        {
+            body(iterations);
+        } else
+        {
+            for (uint64_t i = 0; i < iterations; ++i)
+            {
+                body();
+            }
+        }
+    };
+    auto timeBatch = [&](uint64_t iterations) {
+        Clock::time_point start = Clock::now();
+        runBatch(iterations);
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    };
+
+    // Warm-up in doubling batches, the last batch gives the per iteration estimate.
+    uint64_t iterations = desc.MinIterations;
+    double perIteration = 0.0;
+    Clock::time_point warmupEnd = Clock::now() + desc.WarmupTime;
+    do
+    {
+        perIteration = timeBatch(iterations) / double(iterations);
+        if (Clock::now() < warmupEnd)
+        {
+            iterations = std::min(iterations * 2, desc.MaxIterations);
+        }
+    } while (Clock::now() < warmupEnd);
+    double target = std::chrono::duration<double, std::nano>(desc.SampleTime).count();
+    iterations = uint64_t(std::clamp(target / std::max(perIteration, 0.001), double(desc.MinIterations), double(desc.MaxIterations)));
+
+    BenchmarkResult result;
+    result.Name = name;
+    result.Iterations = iterations;
+    std::vector<double> cycles;
+    std::vector<double> threadCycles;
+    for (uint32_t sample = 0; sample < std::max(desc.SampleCount, 1u); ++sample)
+    {
+        uint64_t startThreadCycles = Platform::ThreadCycleCounter();
+        uint64_t startCycles = Platform::CycleCounter();
+        double nanoseconds = timeBatch(iterations);
+        uint64_t endCycles = Platform::CycleCounter();
+        uint64_t endThreadCycles = Platform::ThreadCycleCounter();
+        result.Samples.push_back(nanoseconds / double(iterations));
+        cycles.push_back(double(endCycles - startCycles) / double(iterations));
+        threadCycles.push_back(double(endThreadCycles - startThreadCycles) / double(iterations));
+    }
+
+    std::vector<double>& samples = result.Samples;
+    std::sort(samples.begin(), samples.end());
+    result.Median = Detail::Percentile(samples, 0.5);
+    result.Min = samples.front();
+    result.Max = samples.back();
+    result.P90 = Detail::Percentile(samples, 0.9);
+    result.P99 = Detail::Percentile(samples, 0.99);
+    double sum = 0.0;
+    std::vector<double> deviations;
+    for (double value : samples)
+    {
+        sum += value;
+        deviations.push_back(std::abs(value - result.Median));
+    }
+    result.Mean = sum / double(samples.size());
+    result.Mad = Detail::Median(std::move(deviations));
+    result.Cycles = Detail::Median(std::move(cycles));
+    result.ThreadCycles = Detail::Median(std::move(threadCycles));
+    return result;
+}
+
+/// <summary>
+/// A named list of benchmarks run together, with a console table and JSON for tracking regressions between runs.
+/// </summary>
+class BenchmarkSuite
+{
+private:
+    struct Entry
+    {
+        std::string Name;
+        std::function<void(uint64_t)> Body;
+    };
+
+    std::string m_Name;
+    std::vector<Entry> m_Entries;
+    std::vector<BenchmarkResult> m_Results;
+
+public:
+    explicit BenchmarkSuite(AnsiStringIn name) : m_Name(name) {}
+
+    /// <summary>
+    /// Register fn() or fn(uint64_t iterations), see RunBenchmark.
+    /// </summary>
+    template<typename Fn>
+    BenchmarkSuite& Add(AnsiStringIn name, Fn fn)
+    {
+        if constexpr (std::is_invocable_v<Fn&, uint64_t>)
+        {
+            m_Entries.push_back({ AnsiString(name), std::function<void(uint64_t)>(std::move(fn)) });
+        } else
+        {
+            m_Entries.push_back({ AnsiString(name), [fn = std::move(fn)](uint64_t iterations) mutable {
+                for (uint64_t i = 0; i < iterations; ++i)
+                {
+                    fn();
+                }
+            } });
+        }
+        return *this;
+    }
+
+    const std::vector<BenchmarkResult>& Run(In<BenchmarkDesc> desc = {})
+    {
+        m_Results.clear();
+        for (Entry& entry : m_Entries)
+        {
+            m_Results.push_back(RunBenchmark(entry.Name, entry.Body, desc));
+        }
+        return m_Results;
+    }
+    const std::vector<BenchmarkResult>& Results() const noexcept { return m_Results; }
+
+    void WriteTable(std::ostream& out) const
+    {
+        std::ios_base::fmtflags flags = out.flags();
+        out << std::left << std::setw(40) << m_Name << std::right << std::setw(12) << "median ns" << std::setw(10) << "mad %"
+            << std::setw(12) << "p99 ns" << std::setw(12) << "cycles" << std::setw(14) << "iterations" << '\n';
+        out << std::fixed << std::setprecision(2);
+        for (const BenchmarkResult& result : m_Results)
+        {
+            out << std::left << std::setw(40) << result.Name << std::right << std::setw(12) << result.Median
+                << std::setw(10) << result.RelativeMad() * 100.0 << std::setw(12) << result.P99
+                << std::setw(12) << result.Cycles << std::setw(14) << result.Iterations << '\n';
+        }
+        out.flags(flags);
+    }
+
+    void WriteJson(std::ostream& out) const
+    {
+        std::ios_base::fmtflags flags = out.flags();
+        std::streamsize precision = out.precision();
+        out << std::setprecision(6) << "{\"suite\":";
+        WriteJsonString(out, m_Name);
+        out << ",\"benchmarks\":[";
+        for (size_t i = 0; i < m_Results.size(); ++i)
+        {
+            const BenchmarkResult& result = m_Results[i];
+            out << (i == 0 ? "\n" : ",\n") << "{\"name\":";
+            WriteJsonString(out, result.Name);
+            out << ",\"iterations\":" << result.Iterations << ",\"samples\":" << result.Samples.size()
+                << ",\"median_ns\":" << result.Median << ",\"mad_ns\":" << result.Mad << ",\"mean_ns\":" << result.Mean
+                << ",\"min_ns\":" << result.Min << ",\"max_ns\":" << result.Max << ",\"p90_ns\":" << result.P90
+                << ",\"p99_ns\":" << result.P99 << ",\"cycles\":" << result.Cycles
+                << ",\"thread_cycles\":" << result.ThreadCycles << '}';
+        }
+        out << "\n]}\n";
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+private:
+    static void WriteJsonString(std::ostream& out, AnsiStringIn text)
+    {
+        out << '"';
+        for (AnsiChar c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out << '\\' << c;
+            } else if (static_cast<unsigned char>(c) >= 0x20)
+            {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+};
+}
@@ -0,0 +1,792 @@
+﻿#pragma once
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <new>
+#include <optional>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+#include "MpmcQueue.hpp"
+#include "ThreadPool.hpp"
+
+namespace Snowy
+{
+// -------------------------------------------------------------
+// Frame Allocation
+// -------------------------------------------------------------
+
+/// <summary>
+/// Pluggable allocator for coroutine frames. Frames created on a thread use that thread's current allocator,
+/// which must outlive them. Allocate may return nullptr to fall back to the global heap.
+/// </summary>
+class CoroFrameAllocator
+{
+public:
+    virtual void* Allocate(size_t size) noexcept = 0;
+    virtual void Deallocate(void* ptr, size_t size) noexcept = 0;
+
+    static CoroFrameAllocator*& Current() noexcept
+    {
+        static thread_local CoroFrameAllocator* s_Current = nullptr;
+        return s_Current;
+    }
+
+protected:
+    ~CoroFrameAllocator() = default;
+};
+
+/// <summary>
+/// Set the current thread's frame allocator for this scope.
+/// </summary>
+class ScopedCoroFrameAllocator
+{
+private:
+    CoroFrameAllocator* m_Previous;
+
+public:
+    explicit ScopedCoroFrameAllocator(CoroFrameAllocator* allocator) noexcept
+        : m_Previous(std::exchange(CoroFrameAllocator::Current(), allocator))
+    {}
+    ~ScopedCoroFrameAllocator() { CoroFrameAllocator::Current() = m_Previous; }
+    ScopedCoroFrameAllocator(const ScopedCoroFrameAllocator&) = delete;
+    ScopedCoroFrameAllocator& operator=(const ScopedCoroFrameAllocator&) = delete;
+};
+
+/// <summary>
+/// Bump allocator over a fixed block, frees are no-ops until Reset. Safe to allocate from several threads.
+/// </summary>
+class CoroFrameArena final : public CoroFrameAllocator
+{
+private:
+    UniqueHandle<std::byte[]> m_Buffer;
+    size_t m_Capacity;
+    std::atomic<size_t> m_Offset{ 0 };
+
+public:
+    explicit CoroFrameArena(size_t capacity) : m_Buffer(new std::byte[capacity]), m_Capacity(capacity) {}
+
+    void* Allocate(size_t size) noexcept override
+    {
+        size = (size + __STDCPP_DEFAULT_NEW_ALIGNMENT__ - 1) & ~size_t(__STDCPP_DEFAULT_NEW_ALIGNMENT__ - 1);
+        size_t offset = m_Offset.fetch_add(size, std::memory_order_relaxed);
+        return offset + size <= m_Capacity ? m_Buffer.get() + offset : nullptr;
+    }
+    void Deallocate(void*, size_t) noexcept override {}
+
+    // Only when no frame allocated from the arena is alive.
+    void Reset() noexcept { m_Offset.store(0, std::memory_order_relaxed); }
+};
+
+/// <summary>
+/// Recycles frames in 64-byte size classes through lock-free bins, frames may be freed on any thread.
+/// </summary>
+class CoroFramePool final : public CoroFrameAllocator
+{
+private:
+    static constexpr size_t s_Granularity = 64;
+    static constexpr size_t s_ClassCount = 32;     // frames up to 2 KB
+
+    std::vector<UniqueHandle<TMpmcQueue<void*>>> m_Bins;
+
+public:
+    explicit CoroFramePool(size_t framesPerClass = 256)
+    {
+        m_Bins.reserve(s_ClassCount);
+        for (size_t i = 0; i < s_ClassCount; ++i)
+        {
+            m_Bins.push_back(MakeUnique<TMpmcQueue<void*>>(framesPerClass));
+        }
+    }
+    ~CoroFramePool()
+    {
+        for (size_t i = 0; i < s_ClassCount; ++i)
+        {
+            void* ptr;
+            while (m_Bins[i]->TryPop(ptr))
+            {
+                ::operator delete(ptr, (i + 1) * s_Granularity);
+            }
+        }
+    }
+
+    void* Allocate(size_t size) noexcept override
+    {
+        size_t index = (size - 1) / s_Granularity;
+        if (index >= s_ClassCount)
+        {
+            return nullptr;
+        }
+        void* ptr;
+        if (m_Bins[index]->TryPop(ptr))
+        {
+            return ptr;
+        }
+        return ::operator new((index + 1) * s_Granularity, std::nothrow);
+    }
+    void Deallocate(void* ptr, size_t size) noexcept override
+    {
+        size_t index = (size - 1) / s_Granularity;
+        if (!m_Bins[index]->TryPush(ptr))
+        {
+            ::operator delete(ptr, (index + 1) * s_Granularity);
+        }
+    }
+};
+
+namespace Detail
+{
+/// <summary>
+/// Promise base routing frame allocation through CoroFrameAllocator::Current(), the owning allocator is stored in front of the frame.
+/// </summary>
+struct CoroPromiseBase
+{
+    static constexpr size_t s_HeaderSize = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+    static void* operator new(size_t size)
+    {
+        CoroFrameAllocator* allocator = CoroFrameAllocator::Current();
+        size_t total = size + s_HeaderSize;
+        void* base = allocator != nullptr ? allocator->Allocate(total) : nullptr;
+        if (base == nullptr)
+        {
+            base = ::operator new(total);
+            allocator = nullptr;
+        }
+        *static_cast<CoroFrameAllocator**>(base) = allocator;
+        return static_cast<std::byte*>(base) + s_HeaderSize;
+    }
+    static void operator delete(void* ptr, size_t size) noexcept
+    {
+        void* base = static_cast<std::byte*>(ptr) - s_HeaderSize;
+        CoroFrameAllocator* allocator = *static_cast<CoroFrameAllocator**>(base);
+        if (allocator != nullptr)
+        {
+            allocator->Deallocate(base, size + s_HeaderSize);
+        } else
+        {
+            ::operator delete(base, size + s_HeaderSize);
+        }
+    }
+};
+
+// Value, exception or nothing yet. void results use std::monostate.
+template<typename T>
+class TCoroResult
+{
+public:
+    using ValueType = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+private:
+    std::variant<std::monostate, ValueType, std::exception_ptr> m_Result;
+
+public:
+    template<typename U>
+    void SetValue(U&& value) { m_Result.template emplace<1>(std::forward<U>(value)); }
+    void SetValue() { m_Result.template emplace<1>(); }
+    void SetException(std::exception_ptr ex) noexcept { m_Result.template emplace<2>(std::move(ex)); }
+
+    ValueType Take()
+    {
+        if (m_Result.index() == 2)
+        {
+            std::rethrow_exception(std::get<2>(m_Result));
+        }
+        return std::move(std::get<1>(m_Result));
+    }
+};
+}
+
+// -------------------------------------------------------------
+// Task
+// -------------------------------------------------------------
+
+/// <summary>
+/// Lazy coroutine task, starts when awaited and resumes its awaiter by symmetric transfer, so chains of awaits don't grow the stack.
+/// </summary>
+/// <typeparam name="T"> Result Type </typeparam>
+template<typename T = void>
+class TTask
+{
+public:
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct FinalAwaiter
+    {
+        bool await_ready() const noexcept { return false; }
+        std::coroutine_handle<> await_suspend(Handle handle) noexcept
+        {
+            std::coroutine_handle<> next = handle.promise().Continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+
+    struct PromiseCommon : Detail::CoroPromiseBase
+    {
+        std::coroutine_handle<> Continuation;
+        Detail::TCoroResult<T> Result;
+
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        FinalAwaiter final_suspend() const noexcept { return {}; }
+        void unhandled_exception() noexcept { Result.SetException(std::current_exception()); }
+    };
+    struct PromiseValue : PromiseCommon
+    {
+        template<typename U = T>
+        void return_value(U&& value) { this->Result.SetValue(std::forward<U>(value)); }
+    };
+    struct PromiseVoid : PromiseCommon
+    {
+        void return_void() { this->Result.SetValue(); }
+    };
+    struct promise_type : std::conditional_t<std::is_void_v<T>, PromiseVoid, PromiseValue>
+    {
+        TTask get_return_object() noexcept { return TTask(Handle::from_promise(*this)); }
+    };
+
+private:
+    Handle m_Handle;
+
+public:
+    TTask() noexcept = default;
+    explicit TTask(Handle handle) noexcept : m_Handle(handle) {}
+    TTask(TTask&& other) noexcept : m_Handle(std::exchange(other.m_Handle, nullptr)) {}
+    TTask& operator=(TTask&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            m_Handle = std::exchange(other.m_Handle, nullptr);
+        }
+        return *this;
+    }
+    TTask(const TTask&) = delete;
+    TTask& operator=(const TTask&) = delete;
+    ~TTask() { Reset(); }
+
+    bool IsValid() const noexcept { return static_cast<bool>(m_Handle); }
+    bool IsDone() const noexcept { return !m_Handle || m_Handle.done(); }
+
+    auto operator co_await() && noexcept { return Awaiter{ m_Handle }; }
+    auto operator co_await() & noexcept { return Awaiter{ m_Handle }; }
+
+private:
+    struct Awaiter
+    {
+        Handle Task;
+
+        bool await_ready() const noexcept { return !Task || Task.done(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+        {
+            Task.promise().Continuation = awaiting;
+            return Task;
+        }
+        decltype(auto) await_resume()
+        {
+            SAssert(Task);
+            if constexpr (std::is_void_v<T>)
+            {
+                Task.promise().Result.Take();
+            } else
+            {
+                return Task.promise().Result.Take();
+            }
+        }
+    };
+
+    void Reset() noexcept
+    {
+        if (m_Handle)
+        {
+            m_Handle.destroy();
+            m_Handle = nullptr;
+        }
+    }
+};
+
+// -------------------------------------------------------------
+// Generator
+// -------------------------------------------------------------
+
+/// <summary>
+/// Synchronous generator, co_yield hands out a reference to the yielded value without copying it.
+/// </summary>
+/// <typeparam name="T"> Yield Type </typeparam>
+template<typename T>
+class TGenerator
+{
+public:
+    struct promise_type : Detail::CoroPromiseBase
+    {
+        std::remove_reference_t<T>* Current = nullptr;
+        std::exception_ptr Exception;
+
+        TGenerator get_return_object() noexcept { return TGenerator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        std::suspend_always final_suspend() const noexcept { return {}; }
+        std::suspend_always yield_value(std::remove_reference_t<T>& value) noexcept { Current = std::addressof(value); return {}; }
+        std::suspend_always yield_value(std::remove_reference_t<T>&& value) noexcept { Current = std::addressof(value); return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { Exception = std::current_exception(); }
+        template<typename U>
+        void await_transform(U&&) = delete;    // no co_await inside a synchronous generator
+    };
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct Sentinel {};
+    class Iterator
+    {
+    private:
+        Handle m_Handle;
+
+    public:
+        explicit Iterator(Handle handle) noexcept : m_Handle(handle) {}
+        std::remove_reference_t<T>& operator*() const noexcept { return *m_Handle.promise().Current; }
+        Iterator& operator++()
+        {
+            m_Handle.resume();
+            if (m_Handle.done() && m_Handle.promise().Exception)
+            {
+                std::rethrow_exception(m_Handle.promise().Exception);
+            }
+            return *this;
+        }
+        bool operator==(Sentinel) const noexcept { return m_Handle.done(); }
+    };
+
+private:
+    Handle m_Handle;
+
+public:
+    explicit TGenerator(Handle handle) noexcept : m_Handle(handle) {}
+    TGenerator(TGenerator&& other) noexcept : m_Handle(std::exchange(other.m_Handle, nullptr)) {}
+    TGenerator& operator=(TGenerator&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (m_Handle)
+            {
+                m_Handle.destroy();
+            }
+            m_Handle = std::exchange(other.m_Handle, nullptr);
+        }
+        return *this;
+    }
+    ~TGenerator()
+    {
+        if (m_Handle)
+        {
+            m_Handle.destroy();
+        }
+    }
+
+    Iterator begin()
+    {
+        Iterator it(m_Handle);
+        return ++it;
+    }
+    Sentinel end() const noexcept { return {}; }
+};
+
+/// <summary>
+/// Generator which may co_await between yields. Consume with: while (T* value = co_await gen.Next()) { ... }
+/// Producer and consumer switch to each other by symmetric transfer.
+/// </summary>
+/// <typeparam name="T"> Yield Type </typeparam>
+template<typename T>
+class TAsyncGenerator
+{
+public:
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct SwitchToConsumer
+    {
+        bool await_ready() const noexcept { return false; }
+        std::coroutine_handle<> await_suspend(Handle handle) noexcept { return handle.promise().Consumer; }
+        void await_resume() const noexcept {}
+    };
+
+    struct promise_type : Detail::CoroPromiseBase
+    {
+        std::remove_reference_t<T>* Current = nullptr;
+        std::coroutine_handle<> Consumer;
+        std::exception_ptr Exception;
+
+        TAsyncGenerator get_return_object() noexcept { return TAsyncGenerator(Handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        SwitchToConsumer final_suspend() const noexcept { return {}; }
+        SwitchToConsumer yield_value(std::remove_reference_t<T>& value) noexcept { Current = std::addressof(value); return {}; }
+        SwitchToConsumer yield_value(std::remove_reference_t<T>&& value) noexcept { Current = std::addressof(value); return {}; }
+        void return_void() noexcept { Current = nullptr; }
+        void unhandled_exception() noexcept { Current = nullptr; Exception = std::current_exception(); }
+    };
+
+private:
+    Handle m_Handle;
+
+    struct NextAwaiter
+    {
+        Handle Generator;
+
+        bool await_ready() const noexcept { return !Generator || Generator.done(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer) noexcept
+        {
+            Generator.promise().Consumer = consumer;
+            return Generator;
+        }
+        // nullptr once the generator finished. The pointee lives until the next Next().
+        std::remove_reference_t<T>* await_resume()
+        {
+            if (!Generator || Generator.done())
+            {
+                if (Generator && Generator.promise().Exception)
+                {
+                    std::rethrow_exception(std::exchange(Generator.promise().Exception, nullptr));
+                }
+                return nullptr;
+            }
+            return Generator.promise().Current;
+        }
+    };
+
+public:
+    explicit TAsyncGenerator(Handle handle) noexcept : m_Handle(handle) {}
+    TAsyncGenerator(TAsyncGenerator&& other) noexcept : m_Handle(std::exchange(other.m_Handle, nullptr)) {}
+    TAsyncGenerator& operator=(TAsyncGenerator&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (m_Handle)
+            {
+                m_Handle.destroy();
+            }
+            m_Handle = std::exchange(other.m_Handle, nullptr);
+        }
+        return *this;
+    }
+    ~TAsyncGenerator()
+    {
+        if (m_Handle)
+        {
+            m_Handle.destroy();
+        }
+    }
+
+    NextAwaiter Next() noexcept { return NextAwaiter{ m_Handle }; }
+};
+
+// -------------------------------------------------------------
+// Scheduler
+// -------------------------------------------------------------
+
+/// <summary>
+/// Where a coroutine resumes after co_await scheduler.Schedule(). The awaiter is the job, so switching threads doesn't allocate.
+/// </summary>
+class CoroScheduler
+{
+public:
+    struct ScheduleAwaiter : ThreadJob
+    {
+        CoroScheduler* Scheduler;
+        std::coroutine_handle<> Handle;
+
+        explicit ScheduleAwaiter(CoroScheduler* scheduler) noexcept : Scheduler(scheduler) {}
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            Handle = handle;
+            Scheduler->Post(this);
+        }
+        void await_resume() const noexcept {}
+        void Execute() noexcept override { Handle.resume(); }
+    };
+
+    virtual void Post(ThreadJob* job) = 0;
+    ScheduleAwaiter Schedule() noexcept { return ScheduleAwaiter(this); }
+
+protected:
+    ~CoroScheduler() = default;
+};
+
+/// <summary>
+/// Resumes right away on the posting thread.
+/// </summary>
+class InlineScheduler final : public CoroScheduler
+{
+public:
+    void Post(ThreadJob* job) override { job->Execute(); }
+};
+
+/// <summary>
+/// Resumes on a ThreadPool worker.
+/// </summary>
+class ThreadPoolScheduler final : public CoroScheduler
+{
+private:
+    ThreadPool& m_Pool;
+
+public:
+    explicit ThreadPoolScheduler(ThreadPool& pool) noexcept : m_Pool(pool) {}
+    void Post(ThreadJob* job) override { m_Pool.Schedule(job); }
+};
+
+// -------------------------------------------------------------
+// Combinators
+// -------------------------------------------------------------
+
+namespace Detail
+{
+/// <summary>
+/// Eagerly started coroutine which frees itself on completion and then transfers to promise.Next if it was set.
+/// </summary>
+struct DetachedTask
+{
+    struct promise_type : CoroPromiseBase
+    {
+        std::coroutine_handle<> Next;
+
+        DetachedTask get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        auto final_suspend() const noexcept
+        {
+            struct FinalAwaiter
+            {
+                bool await_ready() const noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+                {
+                    std::coroutine_handle<> next = handle.promise().Next;
+                    handle.destroy();
+                    return next ? next : std::noop_coroutine();
+                }
+                void await_resume() const noexcept {}
+            };
+            return FinalAwaiter{};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+// co_await inside a DetachedTask to get at its own promise.
+struct GetDetachedPromise
+{
+    DetachedTask::promise_type* Promise = nullptr;
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<DetachedTask::promise_type> handle) noexcept
+    {
+        Promise = &handle.promise();
+        return false;
+    }
+    DetachedTask::promise_type& await_resume() const noexcept { return *Promise; }
+};
+
+template<typename T>
+struct WhenAllAwaiter
+{
+    using SlotType = std::optional<typename TCoroResult<T>::ValueType>;
+
+    std::vector<TTask<T>>& Tasks;
+    std::vector<SlotType>& Slots;
+    std::exception_ptr Exception{};
+    std::atomic<bool> Failed{ false };
+    std::atomic<size_t> Pending{ 0 };
+    std::coroutine_handle<> Continuation{};
+
+    static DetachedTask Run(WhenAllAwaiter& self, size_t index)
+    {
+        try
+        {
+            if constexpr (std::is_void_v<T>)
+            {
+                co_await self.Tasks[index];
+                self.Slots[index].emplace();
+            } else
+            {
+                self.Slots[index].emplace(co_await self.Tasks[index]);
+            }
+        } catch (...)
+        {
+            if (!self.Failed.exchange(true, std::memory_order_acq_rel))
+            {
+                self.Exception = std::current_exception();
+            }
+        }
+        if (self.Pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            DetachedTask::promise_type& promise = co_await GetDetachedPromise{};
+            promise.Next = self.Continuation;
+        }
+    }
+
+    bool await_ready() const noexcept { return Tasks.empty(); }
+    bool await_suspend(std::coroutine_handle<> continuation)
+    {
+        Continuation = continuation;
+        Pending.store(Tasks.size() + 1, std::memory_order_relaxed);
+        for (size_t i = 0; i < Tasks.size(); ++i)
+        {
+            Run(*this, i);
+        }
+        // Our own count: if every task already finished, don't suspend.
+        return Pending.fetch_sub(1, std::memory_order_acq_rel) != 1;
+    }
+    void await_resume()
+    {
+        if (Exception)
+        {
+            std::rethrow_exception(Exception);
+        }
+    }
+};
+
+template<typename T>
+struct WhenAnyState
+{
+    std::vector<TTask<T>> Tasks;
+    std::atomic<bool> Done{ false };
+    size_t Winner = 0;
+    TCoroResult<T> Result;
+    std::coroutine_handle<> Continuation;
+};
+
+template<typename T>
+DetachedTask WhenAnyRun(SharedHandle<WhenAnyState<T>> state, size_t index)
+{
+    TCoroResult<T> result;
+    try
+    {
+        if constexpr (std::is_void_v<T>)
+        {
+            co_await state->Tasks[index];
+            result.SetValue();
+        } else
+        {
+            result.SetValue(co_await state->Tasks[index]);
+        }
+    } catch (...)
+    {
+        result.SetException(std::current_exception());
+    }
+    if (!state->Done.exchange(true, std::memory_order_acq_rel))
+    {
+        state->Winner = index;
+        state->Result = std::move(result);
+        DetachedTask::promise_type& promise = co_await GetDetachedPromise{};
+        promise.Next = state->Continuation;
+    }
+}
+
+template<typename T>
+struct WhenAnyAwaiter
+{
+    SharedHandle<WhenAnyState<T>> State;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> continuation)
+    {
+        // A task finishing inline resumes the continuation, which may destroy this awaiter, so only use a local copy.
+        SharedHandle<WhenAnyState<T>> state = State;
+        state->Continuation = continuation;
+        for (size_t i = 0; i < state->Tasks.size(); ++i)
+        {
+            WhenAnyRun<T>(state, i);
+        }
+    }
+    void await_resume() const noexcept {}
+};
+
+// Shared by SyncWait and its driver coroutine, so the notify never touches memory the woken waiter already released.
+template<typename T>
+struct SyncWaitState
+{
+    std::atomic<uint32_t> Done{ 0 };
+    TCoroResult<T> Result;
+};
+}
+
+/// <summary>
+/// Start every task and complete when all are done, results in task order. Rethrows the first exception after all finished.
+/// </summary>
+template<typename T>
+TTask<std::conditional_t<std::is_void_v<T>, void, std::vector<T>>> WhenAll(std::vector<TTask<T>> tasks)
+{
+    std::vector<typename Detail::WhenAllAwaiter<T>::SlotType> slots(tasks.size());
+    // Named rather than a braced temporary, gcc 12 destroys aggregate temporaries in co_await twice.
+    Detail::WhenAllAwaiter<T> awaiter{ tasks, slots };
+    co_await awaiter;
+    if constexpr (!std::is_void_v<T>)
+    {
+        std::vector<T> results;
+        results.reserve(slots.size());
+        for (auto& slot : slots)
+        {
+            results.push_back(std::move(*slot));
+        }
+        co_return results;
+    }
+}
+
+/// <summary>
+/// Start every task and complete with the index (and value) of the first one to finish.
+/// The others keep running to completion in the background, their results are dropped.
+/// </summary>
+template<typename T>
+TTask<std::conditional_t<std::is_void_v<T>, size_t, std::pair<size_t, T>>> WhenAny(std::vector<TTask<T>> tasks)
+{
+    SAssert(!tasks.empty());
+    auto state = MakeShared<Detail::WhenAnyState<T>>();
+    state->Tasks = std::move(tasks);
+    Detail::WhenAnyAwaiter<T> awaiter{ state };
+    co_await awaiter;
+    if constexpr (std::is_void_v<T>)
+    {
+        state->Result.Take();
+        co_return state->Winner;
+    } else
+    {
+        co_return std::pair<size_t, T>(state->Winner, state->Result.Take());
+    }
+}
+
+/// <summary>
+/// Block the calling thread until task completes and return its result.
+/// </summary>
+template<typename T>
+T SyncWait(TTask<T> task)
+{
+    auto state = MakeShared<Detail::SyncWaitState<T>>();
+    [](TTask<T>& task, SharedHandle<Detail::SyncWaitState<T>> state) -> Detail::DetachedTask {
+        try
+        {
+            if constexpr (std::is_void_v<T>)
+            {
+                co_await task;
+                state->Result.SetValue();
+            } else
+            {
+                state->Result.SetValue(co_await task);
+            }
+        } catch (...)
+        {
+            state->Result.SetException(std::current_exception());
+        }
+        state->Done.store(1, std::memory_order_release);
+        state->Done.notify_one();
+    }(task, state);
+    state->Done.wait(0, std::memory_order_acquire);
+    if constexpr (std::is_void_v<T>)
+    {
+        state->Result.Take();
+    } else
+    {
+        return state->Result.Take();
+    }
+}
+}
@@ -1,6 +1,13 @@
 ﻿#pragma once
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
 #include <type_traits>
 
+#include "Misc.hpp"
+
 namespace Snowy
 {
 /// <summary>
@@ -16,6 +23,27 @@ class Flags
 {
 public:
     using MaskType = typename std::underlying_type_t<BitType>;
+    using UMaskType = typename std::make_unsigned_t<MaskType>;
+
+    // iterates set bits in ascending order, yields each one as a single bit BitType
+    class Iterator
+    {
+    public:
+        constexpr explicit Iterator(UMaskType bits) noexcept : m_Bits(bits) {}
+        constexpr BitType operator*() const noexcept
+        {
+            return static_cast<BitType>(static_cast<MaskType>(UMaskType(1) << std::countr_zero(m_Bits)));
+        }
+        constexpr Iterator& operator++() noexcept
+        {
+            m_Bits &= static_cast<UMaskType>(m_Bits - 1);
+            return *this;
+        }
+        constexpr bool operator==(Iterator const&) const noexcept = default;
+
+    private:
+        UMaskType m_Bits;
+    };
 
     // constructors
     constexpr Flags() noexcept : m_Mask(0) {}
@@ -93,7 +121,48 @@ public:
         return m_Mask;
     }
 
+    // population queries
+    constexpr int Count() const noexcept
+    {
+        return std::popcount(Bits());
+    }
+
+    constexpr bool HasAll(Flags<BitType> const& rhs) const noexcept
+    {
+        return (m_Mask & rhs.m_Mask) == rhs.m_Mask;
+    }
+
+    constexpr bool HasAny(Flags<BitType> const& rhs) const noexcept
+    {
+        return (m_Mask & rhs.m_Mask) != 0;
+    }
+
+    constexpr bool HasNone(Flags<BitType> const& rhs) const noexcept
+    {
+        return (m_Mask & rhs.m_Mask) == 0;
+    }
+
+    // lowest/highest set bit, BitType(0) when empty
+    constexpr BitType LowestBit() const noexcept
+    {
+        return m_Mask ? *begin() : static_cast<BitType>(0);
+    }
+
+    constexpr BitType HighestBit() const noexcept
+    {
+        return m_Mask ? static_cast<BitType>(static_cast<MaskType>(std::bit_floor(Bits()))) : static_cast<BitType>(0);
+    }
+
+    // set bit iteration, only visits bits which are set
+    constexpr Iterator begin() const noexcept { return Iterator(Bits()); }
+    constexpr Iterator end() const noexcept { return Iterator(0); }
+
 private:
+    constexpr UMaskType Bits() const noexcept
+    {
+        return static_cast<UMaskType>(m_Mask);
+    }
+
     MaskType m_Mask;
 };
 
@@ -140,4 +209,301 @@ inline constexpr Flags<BitType> operator~(BitType bit) noexcept
 {
     return ~(Flags<BitType>(bit));
 }
+
+/// <summary>
+/// Fixed-size flag set for enums with more bits than an integer can hold.
+/// Unlike Flags, the enumerator value is the bit index, not the mask.
+/// Bulk operations are plain loops over whole words with a fixed trip count so the compiler can vectorize them.
+/// </summary>
+/// <typeparam name="BitType"> Enum Type, enumerator values in [0, N) </typeparam>
+/// <typeparam name="N"> Bit Count </typeparam>
+template <typename BitType, size_t N>
+class TBitFlags
+{
+public:
+    using WordType = uint64_t;
+    static constexpr size_t BitCount = N;
+    static constexpr size_t WordBits = 64;
+    static constexpr size_t WordCount = (N + WordBits - 1) / WordBits;
+
+    class Iterator
+    {
+    public:
+        constexpr Iterator(const TBitFlags* flags, size_t word, WordType bits) noexcept
+            : m_Flags(flags), m_Word(word), m_Bits(bits)
+        {
+            SkipEmptyWords();
+        }
+        constexpr BitType operator*() const noexcept
+        {
+            return static_cast<BitType>(m_Word * WordBits + std::countr_zero(m_Bits));
+        }
+        constexpr Iterator& operator++() noexcept
+        {
+            m_Bits &= m_Bits - 1;
+            SkipEmptyWords();
+            return *this;
+        }
+        constexpr bool operator==(const Iterator& other) const noexcept
+        {
+            return m_Word == other.m_Word && m_Bits == other.m_Bits;
+        }
+
+    private:
+        constexpr void SkipEmptyWords() noexcept
+        {
+            while (m_Bits == 0 && m_Word + 1 < WordCount)
+            {
+                m_Bits = m_Flags->m_Words[++m_Word];
+            }
+            if (m_Bits == 0)
+            {
+                m_Word = WordCount;
+            }
+        }
+
+        const TBitFlags* m_Flags;
+        size_t m_Word;
+        WordType m_Bits;
+    };
+
+    // constructors
+    constexpr TBitFlags() noexcept = default;
+
+    constexpr TBitFlags(BitType bit) noexcept { Set(bit); }
+
+    constexpr TBitFlags(std::initializer_list<BitType> bits) noexcept
+    {
+        for (BitType bit : bits)
+        {
+            Set(bit);
+        }
+    }
+
+    constexpr TBitFlags(TBitFlags const& rhs) noexcept = default;
+
+    static constexpr TBitFlags AllFlags() noexcept
+    {
+        TBitFlags result;
+        for (size_t i = 0; i < WordCount; ++i)
+        {
+            result.m_Words[i] = ~WordType(0);
+        }
+        result.ClearPadding();
+        return result;
+    }
+
+    // relational operators
+    auto operator<=>(TBitFlags const&) const = default;
+
+    // logical operator
+    constexpr bool operator!() const noexcept
+    {
+        return !Any();
+    }
+
+    // bitwise operators
+    constexpr TBitFlags operator&(TBitFlags const& rhs) const noexcept
+    {
+        TBitFlags result(*this);
+        return result &= rhs;
+    }
+
+    constexpr TBitFlags operator|(TBitFlags const& rhs) const noexcept
+    {
+        TBitFlags result(*this);
+        return result |= rhs;
+    }
+
+    constexpr TBitFlags operator^(TBitFlags const& rhs) const noexcept
+    {
+        TBitFlags result(*this);
+        return result ^= rhs;
+    }
+
+    constexpr TBitFlags operator~() const noexcept
+    {
+        TBitFlags result;
+        for (size_t i = 0; i < WordCount; ++i)
+        {
+            result.m_Words[i] = ~m_Words[i];
+        }
+        result.ClearPadding();
+        return result;
+    }
+
+    // this & ~rhs
+    constexpr TBitFlags AndNot(TBitFlags const& rhs) const noexcept
+    {
+        TBitFlags result;
+        for (size_t i = 0; i < WordCount; ++i)
+        {
+            result.m_Words[i] = m_Words[i] & ~rhs.m_Words[i];
+        }
+        return result;
+    }
+
+    // assignment operators
+    constexpr TBitFlags& operator=(TBitFlags const& rhs) noexcept = default;
+
+    constexpr TBitFlags& operator|=(TBitFlags const& rhs) noexcept
+    {
+        for (size_t i = 0; i < WordCount; ++i)
+        {
+            m_Words[i] |= rhs.m_Words[i];
+        }
+        return *this;
+    }
+
+    constexpr TBitFlags& operator&=(TBitFlags const& rhs) noexcept
+    {
+        for (size_t i = 0; i < WordCount; ++i)
+        {
+            m_Words[i] &= rhs.m_Words[i];
+        }
+        return *this;
+    }
+
+    constexpr TBitFlags& operator^=(TBitFlags const& rhs) noexcept
+    {
+        for (size_t i = 0; i < WordCount; ++i)
+        {
+            m_Words[i] ^= rhs.m_Words[i];
+        }
+        return *this;
+    }
+
+    // cast operators
+    explicit constexpr operator bool() const noexcept
+    {
+        return Any();
+    }
+
+    // bit access
+    constexpr bool Test(BitType bit) const noexcept
+    {
+        size_t index = Index(bit);
+        return (m_Words[index / WordBits] >> (index % WordBits)) & 1;
+    }
+
+    constexpr TBitFlags& Set(BitType bit, bool value = true) noexcept
+    {
+        size_t index = Index(bit);
+        WordType mask = WordType(1) << (index % WordBits);
+        m_Words[index / WordBits] = value ? (m_Words[index / WordBits] | mask) : (m_Words[index / WordBits] & ~mask);
+        return *this;
+    }
+
+    constexpr TBitFlags& Reset(BitType bit) noexcept
+    {
+        return Set(bit, false);
+    }
+
+    constexpr void Clear() noexcept
+    {
+        for (size_t i = 0; i < WordCount; ++i)
+        {
+            m_Words[i] = 0;
+        }
+    }
+
+    // population queries, reduce over every word without early exit so the loops stay branchless
+    constexpr size_t Count() const noexcept
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < WordCount; ++i)
+        {
+            count += static_cast<size_t>(std::popcount(m_Words[i]));
+        }
+        return count;
+    }
+
+    constexpr bool Any() const noexcept
+    {
+        WordType acc = 0;
+        for (size_t i = 0; i < WordCount; ++i)
+        {
+            acc |= m_Words[i];
+        }
+        return acc != 0;
+    }
+
+    constexpr bool None() const noexcept
+    {
+        return !Any();
+    }
+
+    constexpr bool All() const noexcept
+    {
+        return *this == AllFlags();
+    }
+
+    // true if every bit of rhs is set in this
+    constexpr bool HasAll(TBitFlags const& rhs) const noexcept
+    {
+        WordType acc = 0;
+        for (size_t i = 0; i < WordCount; ++i)
+        {
+            acc |= rhs.m_Words[i] & ~m_Words[i];
+        }
+        return acc == 0;
+    }
+
+    constexpr bool HasAny(TBitFlags const& rhs) const noexcept
+    {
+        WordType acc = 0;
+        for (size_t i = 0; i < WordCount; ++i)
+        {
+            acc |= rhs.m_Words[i] & m_Words[i];
+        }
+        return acc != 0;
+    }
+
+    constexpr bool IsSubsetOf(TBitFlags const& rhs) const noexcept
+    {
+        return rhs.HasAll(*this);
+    }
+
+    // set bit iteration, yields BitType in ascending order
+    constexpr Iterator begin() const noexcept { return Iterator(this, 0, m_Words[0]); }
+    constexpr Iterator end() const noexcept { return Iterator(this, WordCount, 0); }
+
+    constexpr const WordType* Words() const noexcept { return m_Words; }
+
+private:
+    static constexpr size_t Index(BitType bit) noexcept
+    {
+        size_t index = static_cast<size_t>(bit);
+        SAssert(index < N);
+        return index;
+    }
+
+    constexpr void ClearPadding() noexcept
+    {
+        if constexpr (N % WordBits != 0)
+        {
+            m_Words[WordCount - 1] &= (WordType(1) << (N % WordBits)) - 1;
+        }
+    }
+
+    WordType m_Words[WordCount]{};
+};
+
+template <typename BitType, size_t N>
+constexpr TBitFlags<BitType, N> operator&(BitType bit, TBitFlags<BitType, N> const& flags) noexcept
+{
+    return flags.operator&(bit);
+}
+
+template <typename BitType, size_t N>
+constexpr TBitFlags<BitType, N> operator|(BitType bit, TBitFlags<BitType, N> const& flags) noexcept
+{
+    return flags.operator|(bit);
+}
+
+template <typename BitType, size_t N>
+constexpr TBitFlags<BitType, N> operator^(BitType bit, TBitFlags<BitType, N> const& flags) noexcept
+{
+    return flags.operator^(bit);
+}
 }
@@ -0,0 +1,255 @@
+﻿#pragma once
+#include <array>
+#include <bit>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "EnumFlags.hpp"
+#include "Typedef.hpp"
+
+namespace Snowy
+{
+namespace Detail
+{
+/// <summary>
+/// Name of enum value V taken from the compiler's pretty function signature, empty if V is not a named enumerator.
+/// </summary>
+template<auto V>
+constexpr AnsiStringView EnumValueName() noexcept
+{
+#if defined(__clang__) || defined(__GNUC__)
+    // "... [with auto V = EFoo::Bar; ...]" or "... [V = EFoo::Bar]"
+    AnsiStringView sig = __PRETTY_FUNCTION__;
+    size_t begin = sig.find("V = ") + 4;
+    size_t end = sig.find_first_of(";]", begin);
+    AnsiStringView value = sig.substr(begin, end - begin);
+#elif defined(_MSC_VER)
+    // "... __cdecl Snowy::Detail::EnumValueName<EFoo::Bar>(void)"
+    AnsiStringView sig = __FUNCSIG__;
+    sig.remove_suffix(sizeof(">(void)") - 1);
+    AnsiStringView value = sig.substr(sig.rfind('<') + 1);
+#else
+    #error "Compiler is not support!"
+#endif
+    // Invalid values print as a cast, "(EFoo)4" or "(enum EFoo)0x4".
+    if (value.empty() || value.front() == '(' || (value.front() >= '0' && value.front() <= '9') || value.front() == '-')
+    {
+        return {};
+    }
+    size_t colon = value.rfind(':');
+    return colon == AnsiStringView::npos ? value : value.substr(colon + 1);
+}
+
+// Only an enum with a fixed underlying type can be list-initialized from an integer, and only such an enum can hold
+// every bit of that type in a constant expression.
+template<typename E>
+concept HasFixedUnderlyingType = std::is_enum_v<E> && requires { E{ std::underlying_type_t<E>{} }; };
+
+constexpr uint32_t HashName(AnsiStringView name, uint32_t seed) noexcept
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u ^ seed;
+    for (char c : name)
+    {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return hash;
+}
+}
+
+/// <summary>
+/// Compile-time reflection of a flag bits enum, whose enumerators are single bit masks as used by Flags.
+/// Names, the full mask and the name lookup table are all built at compile time.
+/// </summary>
+/// <typeparam name="BitType"> Flag Bits Enum Type </typeparam>
+template<typename BitType>
+struct EnumReflect
+{
+    static_assert(std::is_enum_v<BitType>, "EnumReflect requires an enum type.");
+    static_assert(Detail::HasFixedUnderlyingType<BitType>, "EnumReflect requires an enum class or an enum with a fixed underlying type.");
+
+    using MaskType = std::underlying_type_t<BitType>;
+    using UMaskType = std::make_unsigned_t<MaskType>;
+    static constexpr size_t BitCount = sizeof(MaskType) * 8;
+
+private:
+    template<size_t... I>
+    static constexpr std::array<AnsiStringView, BitCount> MakeBitNames(std::index_sequence<I...>) noexcept
+    {
+        return { Detail::EnumValueName<static_cast<BitType>(static_cast<MaskType>(UMaskType(1) << I))>()... };
+    }
+
+public:
+    // BitNames[i] is the name of the enumerator equal to (1 << i), empty if there is none.
+    static constexpr std::array<AnsiStringView, BitCount> BitNames = MakeBitNames(std::make_index_sequence<BitCount>{});
+
+    static constexpr UMaskType AllMask = [] {
+        UMaskType mask = 0;
+        for (size_t i = 0; i < BitCount; ++i)
+        {
+            if (!BitNames[i].empty())
+            {
+                mask |= UMaskType(1) << i;
+            }
+        }
+        return mask;
+    }();
+    static constexpr size_t NameCount = static_cast<size_t>(std::popcount(AllMask));
+
+    static constexpr Flags<BitType> AllFlags = Flags<BitType>(static_cast<MaskType>(AllMask));
+
+    static constexpr AnsiStringView NameOf(BitType bit) noexcept
+    {
+        UMaskType mask = static_cast<UMaskType>(bit);
+        return std::has_single_bit(mask) ? BitNames[std::countr_zero(mask)] : AnsiStringView();
+    }
+
+private:
+    // Perfect hash over the enumerator names: the first seed which gives every name its own slot.
+    static constexpr size_t s_TableSize = std::bit_ceil(NameCount * 2 + 1);
+
+    struct HashTable
+    {
+        uint32_t Seed = 0;
+        std::array<uint8_t, s_TableSize> Slots{};    // bit index + 1, 0 is empty
+    };
+
+    static constexpr HashTable BuildTable() noexcept
+    {
+        for (uint32_t seed = 0;; ++seed)
+        {
+            HashTable table;
+            table.Seed = seed;
+            bool collision = false;
+            for (size_t i = 0; i < BitCount && !collision; ++i)
+            {
+                if (BitNames[i].empty())
+                {
+                    continue;
+                }
+                uint8_t& slot = table.Slots[Detail::HashName(BitNames[i], seed) & (s_TableSize - 1)];
+                collision = slot != 0;
+                slot = static_cast<uint8_t>(i + 1);
+            }
+            if (!collision)
+            {
+                return table;
+            }
+        }
+    }
+    static constexpr HashTable s_Table = BuildTable();
+
+public:
+    /// <summary>
+    /// Look up a single enumerator by name, one hash and one string compare.
+    /// </summary>
+    static constexpr bool Find(AnsiStringIn name, Out<BitType> bit) noexcept
+    {
+        uint8_t slot = s_Table.Slots[Detail::HashName(name, s_Table.Seed) & (s_TableSize - 1)];
+        if (slot == 0 || BitNames[slot - 1] != name)
+        {
+            return false;
+        }
+        *bit = static_cast<BitType>(static_cast<MaskType>(UMaskType(1) << (slot - 1)));
+        return true;
+    }
+};
+
+/// <summary>
+/// FlagTraits base for reflected enums, specialize FlagTraits by deriving from it:
+/// template <> struct FlagTraits<EFooBits> : ReflectedFlagTraits<EFooBits> {};
+/// </summary>
+template<typename BitType>
+struct ReflectedFlagTraits
+{
+    static constexpr bool IsBitmask = true;
+    static constexpr Flags<BitType> AllFlags = EnumReflect<BitType>::AllFlags;
+};
+
+/// <summary>
+/// Write flags as "A | B | C" into buffer, "None" when empty, unnamed bits as hex.
+/// Output is truncated to the buffer size, the returned view covers what was written.
+/// </summary>
+template<typename BitType>
+constexpr AnsiStringView ToString(Flags<BitType> flags, std::span<AnsiChar> buffer) noexcept
+{
+    using Reflect = EnumReflect<BitType>;
+    size_t size = 0;
+    auto append = [&](AnsiStringView text) {
+        for (size_t i = 0; i < text.size() && size < buffer.size(); ++i)
+        {
+            buffer[size++] = text[i];
+        }
+    };
+
+    auto mask = static_cast<typename Reflect::UMaskType>(flags.Value());
+    if (mask == 0)
+    {
+        append("None");
+        return AnsiStringView(buffer.data(), size);
+    }
+    for (BitType bit : flags & Reflect::AllFlags)
+    {
+        if (size != 0)
+        {
+            append(" | ");
+        }
+        append(Reflect::NameOf(bit));
+    }
+    if (auto unknown = mask & ~Reflect::AllMask; unknown != 0)
+    {
+        if (size != 0)
+        {
+            append(" | ");
+        }
+        AnsiChar hex[2 + sizeof(unknown) * 2];
+        size_t digits = 0;
+        for (auto v = unknown; v != 0; v >>= 4)
+        {
+            hex[sizeof(hex) - 1 - digits++] = "0123456789ABCDEF"[v & 0xF];
+        }
+        hex[sizeof(hex) - 2 - digits] = '0';
+        hex[sizeof(hex) - 1 - digits] = 'x';
+        append(AnsiStringView(hex + sizeof(hex) - 2 - digits, digits + 2));
+    }
+    return AnsiStringView(buffer.data(), size);
+}
+
+/// <summary>
+/// Parse "A | B | C" (spaces optional, "None" or empty for no flags). Returns false on an unknown name.
+/// </summary>
+template<typename BitType>
+constexpr bool FromString(AnsiStringIn str, Out<Flags<BitType>> flags) noexcept
+{
+    Flags<BitType> result;
+    // Every '|' must be followed by a token, so "A|" fails like "A||B" does.
+    for (bool more = !str.empty(); more;)
+    {
+        size_t split = str.find('|');
+        AnsiStringView token = str.substr(0, split);
+        more = split != AnsiStringView::npos;
+        str = more ? str.substr(split + 1) : AnsiStringView();
+
+        while (!token.empty() && (token.front() == ' ' || token.front() == '\t'))
+        {
+            token.remove_prefix(1);
+        }
+        while (!token.empty() && (token.back() == ' ' || token.back() == '\t'))
+        {
+            token.remove_suffix(1);
+        }
+        BitType bit{};
+        if (EnumReflect<BitType>::Find(token, &bit))
+        {
+            result |= bit;
+        } else if (token != "None" || split != AnsiStringView::npos || result)
+        {
+            return false;
+        }
+    }
+    *flags = result;
+    return true;
+}
+}
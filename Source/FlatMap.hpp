@@ -0,0 +1,350 @@
+﻿#pragma once
+#include <algorithm>
+#include <concepts>
+#include <functional>
+#include <initializer_list>
+#include <numeric>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+
+namespace Snowy
+{
+/// <summary>
+/// Branchless lower bound over a sorted array: the loop body compiles to a cmov, so there's no mispredict per level.
+/// </summary>
+template<typename T, typename Q, typename Compare>
+inline const T* FlatLowerBound(const T* base, size_t size, const Q& key, const Compare& less)
+{
+    if (size == 0)
+    {
+        return base;
+    }
+    while (size > 1)
+    {
+        size_t half = size / 2;
+        base = less(base[half - 1], key) ? base + half : base;
+        size -= half;
+    }
+    return base + (less(*base, key) ? 1 : 0);
+}
+
+template<typename Compare>
+concept IsTransparentCompare = requires { typename Compare::is_transparent; };
+
+/// <summary>
+/// Sorted flat map for small read-mostly tables, keys and values in separate contiguous arrays so searches only touch keys.
+/// With a transparent Compare (the default std::less<>) lookups accept any comparable key, e.g. SStringIn for SString keys.
+/// Insert-heavy phases should go between BeginBatch/EndBatch: inserts are appended, then sorted and merged once.
+/// Duplicate keys from bulk build keep the last value, batched inserts keep the same semantics as unbatched ones.
+/// </summary>
+/// <typeparam name="K"> Key Type </typeparam>
+/// <typeparam name="V"> Value Type </typeparam>
+/// <typeparam name="Compare"> Strict Weak Ordering </typeparam>
+template<typename K, typename V, typename Compare = std::less<>>
+class TFlatMap
+{
+public:
+    using KeyType = K;
+    using ValueType = V;
+
+private:
+    std::vector<K> m_Keys;
+    std::vector<V> m_Values;
+    size_t m_SortedSize = 0;    // entries past this are pending batch inserts
+    std::vector<bool> m_PendingAssign;  // per pending entry, InsertOrAssign rather than Insert
+    bool m_Batching = false;
+    [[no_unique_address]] Compare m_Less;
+
+public:
+    TFlatMap() = default;
+
+    /// <summary>
+    /// Bulk build, entries in any order.
+    /// </summary>
+    explicit TFlatMap(std::vector<std::pair<K, V>> entries)
+    {
+        m_Keys.reserve(entries.size());
+        m_Values.reserve(entries.size());
+        for (auto& [key, value] : entries)
+        {
+            m_Keys.push_back(std::move(key));
+            m_Values.push_back(std::move(value));
+        }
+        m_PendingAssign.assign(m_Keys.size(), true);
+        SortAndMerge();
+    }
+    TFlatMap(std::initializer_list<std::pair<K, V>> entries)
+        : TFlatMap(std::vector<std::pair<K, V>>(entries))
+    {}
+
+    size_t Size() const noexcept { return m_Keys.size(); }
+    bool Empty() const noexcept { return m_Keys.empty(); }
+    void Reserve(size_t count) { m_Keys.reserve(count); m_Values.reserve(count); }
+    void Clear() noexcept { m_Keys.clear(); m_Values.clear(); m_PendingAssign.clear(); m_SortedSize = 0; }
+
+    ArrayIn<K> Keys() const noexcept { return m_Keys; }
+    ArrayIn<V> Values() const noexcept { return m_Values; }
+    std::span<V> Values() noexcept { return m_Values; }
+    const K& KeyAt(size_t index) const noexcept { return m_Keys[index]; }
+    V& ValueAt(size_t index) noexcept { return m_Values[index]; }
+    const V& ValueAt(size_t index) const noexcept { return m_Values[index]; }
+
+    // -------------------------------------------------------------
+    // Lookup
+    // -------------------------------------------------------------
+
+    template<typename Q = K>
+        requires std::same_as<Q, K> || IsTransparentCompare<Compare>
+    const V* Find(const Q& key) const
+    {
+        size_t index = IndexOf(key);
+        return index != Size() ? &m_Values[index] : nullptr;
+    }
+    template<typename Q = K>
+        requires std::same_as<Q, K> || IsTransparentCompare<Compare>
+    V* Find(const Q& key)
+    {
+        size_t index = IndexOf(key);
+        return index != Size() ? &m_Values[index] : nullptr;
+    }
+    template<typename Q = K>
+        requires std::same_as<Q, K> || IsTransparentCompare<Compare>
+    bool Contains(const Q& key) const
+    {
+        return IndexOf(key) != Size();
+    }
+    // Index of key, Size() if absent.
+    template<typename Q = K>
+        requires std::same_as<Q, K> || IsTransparentCompare<Compare>
+    size_t IndexOf(const Q& key) const
+    {
+        SAssert(!m_Batching);
+        const K* it = FlatLowerBound(m_Keys.data(), m_Keys.size(), key, m_Less);
+        size_t index = static_cast<size_t>(it - m_Keys.data());
+        return index != m_Keys.size() && !m_Less(key, *it) ? index : m_Keys.size();
+    }
+
+    // -------------------------------------------------------------
+    // Modify
+    // -------------------------------------------------------------
+
+    /// <summary>
+    /// Returns false and leaves the value untouched if key exists. Outside a batch this is O(n) for the shift.
+    /// In a batch the check is deferred: it returns true, and EndBatch keeps the existing or first inserted value.
+    /// </summary>
+    bool Insert(K key, V value)
+    {
+        if (m_Batching)
+        {
+            AppendPending(std::move(key), std::move(value), false);
+            return true;
+        }
+        size_t index = LowerIndex(key);
+        if (index != m_Keys.size() && !m_Less(key, m_Keys[index]))
+        {
+            return false;
+        }
+        m_Keys.insert(m_Keys.begin() + index, std::move(key));
+        m_Values.insert(m_Values.begin() + index, std::move(value));
+        m_SortedSize = m_Keys.size();
+        return true;
+    }
+    void InsertOrAssign(K key, V value)
+    {
+        if (m_Batching)
+        {
+            AppendPending(std::move(key), std::move(value), true);
+            return;
+        }
+        size_t index = LowerIndex(key);
+        if (index != m_Keys.size() && !m_Less(key, m_Keys[index]))
+        {
+            m_Values[index] = std::move(value);
+            return;
+        }
+        m_Keys.insert(m_Keys.begin() + index, std::move(key));
+        m_Values.insert(m_Values.begin() + index, std::move(value));
+        m_SortedSize = m_Keys.size();
+    }
+    template<typename Q = K>
+        requires std::same_as<Q, K> || IsTransparentCompare<Compare>
+    bool Erase(const Q& key)
+    {
+        size_t index = IndexOf(key);
+        if (index == m_Keys.size())
+        {
+            return false;
+        }
+        m_Keys.erase(m_Keys.begin() + index);
+        m_Values.erase(m_Values.begin() + index);
+        m_SortedSize = m_Keys.size();
+        return true;
+    }
+
+    /// <summary>
+    /// Until EndBatch, inserts are appended unsorted and lookups are not allowed.
+    /// </summary>
+    void BeginBatch() noexcept
+    {
+        m_Batching = true;
+    }
+    /// <summary>
+    /// Sort the pending inserts and merge them into the table in one pass. Per key the result is what the same calls
+    /// would have produced unbatched: the last InsertOrAssign wins, otherwise the existing or first inserted value.
+    /// </summary>
+    void EndBatch()
+    {
+        m_Batching = false;
+        SortAndMerge();
+    }
+
+private:
+    void AppendPending(K key, V value, bool assign)
+    {
+        m_Keys.push_back(std::move(key));
+        m_Values.push_back(std::move(value));
+        m_PendingAssign.push_back(assign);
+    }
+
+    size_t LowerIndex(const K& key) const
+    {
+        return static_cast<size_t>(FlatLowerBound(m_Keys.data(), m_Keys.size(), key, m_Less) - m_Keys.data());
+    }
+
+    // Stable sort the tail [m_SortedSize, Size()), then merge with the sorted head and resolve each run of equal keys.
+    void SortAndMerge()
+    {
+        size_t count = m_Keys.size();
+        if (m_SortedSize == count)
+        {
+            return;
+        }
+        std::vector<size_t> order(count);
+        std::iota(order.begin(), order.end(), size_t(0));
+        auto byKey = [&](size_t a, size_t b) { return m_Less(m_Keys[a], m_Keys[b]); };
+        std::stable_sort(order.begin() + m_SortedSize, order.end(), byKey);
+        std::inplace_merge(order.begin(), order.begin() + m_SortedSize, order.end(), byKey);
+
+        std::vector<K> keys;
+        std::vector<V> values;
+        keys.reserve(count);
+        values.reserve(count);
+        for (size_t i = 0; i < count;)
+        {
+            // Merge and stable sort keep the existing entry first and the pending ones in call order within a run,
+            // so the first entry stands unless a later InsertOrAssign replaces it.
+            size_t chosen = order[i];
+            size_t next = i + 1;
+            for (; next < count && !m_Less(m_Keys[order[i]], m_Keys[order[next]]); ++next)
+            {
+                if (m_PendingAssign[order[next] - m_SortedSize])
+                {
+                    chosen = order[next];
+                }
+            }
+            keys.push_back(std::move(m_Keys[chosen]));
+            values.push_back(std::move(m_Values[chosen]));
+            i = next;
+        }
+        m_Keys = std::move(keys);
+        m_Values = std::move(values);
+        m_PendingAssign.clear();
+        m_SortedSize = m_Keys.size();
+    }
+};
+
+/// <summary>
+/// Sorted flat set, see TFlatMap.
+/// </summary>
+/// <typeparam name="K"> Key Type </typeparam>
+/// <typeparam name="Compare"> Strict Weak Ordering </typeparam>
+template<typename K, typename Compare = std::less<>>
+class TFlatSet
+{
+public:
+    using KeyType = K;
+
+private:
+    std::vector<K> m_Keys;
+    size_t m_SortedSize = 0;
+    bool m_Batching = false;
+    [[no_unique_address]] Compare m_Less;
+
+public:
+    TFlatSet() = default;
+    explicit TFlatSet(std::vector<K> keys) : m_Keys(std::move(keys)) { SortAndMerge(); }
+    TFlatSet(std::initializer_list<K> keys) : TFlatSet(std::vector<K>(keys)) {}
+
+    size_t Size() const noexcept { return m_Keys.size(); }
+    bool Empty() const noexcept { return m_Keys.empty(); }
+    void Reserve(size_t count) { m_Keys.reserve(count); }
+    void Clear() noexcept { m_Keys.clear(); m_SortedSize = 0; }
+
+    operator ArrayIn<K>() const noexcept { return m_Keys; }
+    ArrayIn<K> Keys() const noexcept { return m_Keys; }
+    const K* begin() const noexcept { return m_Keys.data(); }
+    const K* end() const noexcept { return m_Keys.data() + m_Keys.size(); }
+
+    template<typename Q = K>
+        requires std::same_as<Q, K> || IsTransparentCompare<Compare>
+    bool Contains(const Q& key) const
+    {
+        SAssert(!m_Batching);
+        const K* it = FlatLowerBound(m_Keys.data(), m_Keys.size(), key, m_Less);
+        return it != end() && !m_Less(key, *it);
+    }
+
+    bool Insert(K key)
+    {
+        if (m_Batching)
+        {
+            m_Keys.push_back(std::move(key));
+            return true;
+        }
+        const K* it = FlatLowerBound(m_Keys.data(), m_Keys.size(), key, m_Less);
+        if (it != end() && !m_Less(key, *it))
+        {
+            return false;
+        }
+        m_Keys.insert(m_Keys.begin() + (it - m_Keys.data()), std::move(key));
+        m_SortedSize = m_Keys.size();
+        return true;
+    }
+    template<typename Q = K>
+        requires std::same_as<Q, K> || IsTransparentCompare<Compare>
+    bool Erase(const Q& key)
+    {
+        SAssert(!m_Batching);
+        const K* it = FlatLowerBound(m_Keys.data(), m_Keys.size(), key, m_Less);
+        if (it == end() || m_Less(key, *it))
+        {
+            return false;
+        }
+        m_Keys.erase(m_Keys.begin() + (it - m_Keys.data()));
+        m_SortedSize = m_Keys.size();
+        return true;
+    }
+
+    void BeginBatch() noexcept { m_Batching = true; }
+    void EndBatch()
+    {
+        m_Batching = false;
+        SortAndMerge();
+    }
+
+private:
+    void SortAndMerge()
+    {
+        auto middle = m_Keys.begin() + m_SortedSize;
+        std::sort(middle, m_Keys.end(), m_Less);
+        std::inplace_merge(m_Keys.begin(), middle, m_Keys.end(), m_Less);
+        auto equal = [&](const K& a, const K& b) { return !m_Less(a, b); };
+        m_Keys.erase(std::unique(m_Keys.begin(), m_Keys.end(), equal), m_Keys.end());
+        m_SortedSize = m_Keys.size();
+    }
+};
+}
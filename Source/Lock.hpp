@@ -0,0 +1,335 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+
+namespace Snowy
+{
+// The lock types below use the lowercase lock/unlock/try_lock names so they work with std::lock_guard,
+// std::unique_lock and std::shared_lock.
+
+/// <summary>
+/// Test and test-and-set spinlock. Waiters spin on a plain load with exponential pause backoff,
+/// so the cache line is only written when the lock looks free. For critical sections of a few dozen nanoseconds.
+/// </summary>
+class alignas(g_CacheLineSize) SpinLock
+{
+private:
+    static constexpr uint32_t s_MaxBackoff = 64;
+
+    std::atomic<bool> m_Locked{ false };
+
+public:
+    SpinLock() = default;
+    SpinLock(const SpinLock&) = delete;
+    SpinLock& operator=(const SpinLock&) = delete;
+
+    void lock() noexcept
+    {
+        uint32_t backoff = 1;
+        while (m_Locked.exchange(true, std::memory_order_acquire))
+        {
+            do
+            {
+                for (uint32_t i = 0; i < backoff; ++i)
+                {
+                    Platform::CpuPause();
+                }
+                backoff = std::min(backoff * 2, s_MaxBackoff);
+            } while (m_Locked.load(std::memory_order_relaxed));
+        }
+    }
+    bool try_lock() noexcept
+    {
+        return !m_Locked.load(std::memory_order_relaxed) && !m_Locked.exchange(true, std::memory_order_acquire);
+    }
+    void unlock() noexcept { m_Locked.store(false, std::memory_order_release); }
+
+    bool IsLocked() const noexcept { return m_Locked.load(std::memory_order_relaxed); }
+};
+
+/// <summary>
+/// Spins for a short while, then sleeps on the lock word (WaitOnAddress / futex through std::atomic::wait).
+/// Uncontended lock and unlock are a single atomic each, unlock only enters the kernel if someone is asleep.
+/// </summary>
+class alignas(g_CacheLineSize) HybridMutex
+{
+private:
+    static constexpr uint32_t s_SpinCount = 64;
+    enum : uint32_t { Unlocked = 0, Locked = 1, Contended = 2 };
+
+    std::atomic<uint32_t> m_State{ Unlocked };
+
+public:
+    HybridMutex() = default;
+    HybridMutex(const HybridMutex&) = delete;
+    HybridMutex& operator=(const HybridMutex&) = delete;
+
+    void lock() noexcept
+    {
+        if (try_lock())
+        {
+            return;
+        }
+        for (uint32_t i = 0, backoff = 1; i < s_SpinCount; ++i)
+        {
+            for (uint32_t p = 0; p < backoff; ++p)
+            {
+                Platform::CpuPause();
+            }
+            backoff = std::min(backoff * 2, 16u);
+            uint32_t state = m_State.load(std::memory_order_relaxed);
+            if (state == Contended)
+            {
+                break;
+            }
+            if (state == Unlocked && try_lock())
+            {
+                return;
+            }
+        }
+        // Mark the lock contended so unlock knows to wake us, and sleep until it changes.
+        while (m_State.exchange(Contended, std::memory_order_acquire) != Unlocked)
+        {
+            m_State.wait(Contended, std::memory_order_relaxed);
+        }
+    }
+    bool try_lock() noexcept
+    {
+        uint32_t expected = Unlocked;
+        return m_State.compare_exchange_strong(expected, Locked, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+    void unlock() noexcept
+    {
+        if (m_State.exchange(Unlocked, std::memory_order_release) == Contended)
+        {
+            m_State.notify_one();
+        }
+    }
+};
+
+/// <summary>
+/// Writer-preferring reader-writer lock. Readers count themselves in one of ReaderSlots padded counters picked per thread,
+/// so concurrent readers don't all bounce one cache line. A writer closes the gate to new readers and waits for the
+/// counters to drain, so a stream of readers can't starve it. Writing is the expensive side, keep it rare.
+/// </summary>
+/// <typeparam name="ReaderSlots"> Reader Counter Count </typeparam>
+template<size_t ReaderSlots = 16>
+class TRWLock
+{
+    static_assert(ReaderSlots > 0, "TRWLock needs at least one reader slot.");
+
+private:
+    struct alignas(g_CacheLineSize) Slot
+    {
+        std::atomic<uint32_t> Readers{ 0 };
+    };
+
+    Slot m_Slots[ReaderSlots];
+    alignas(g_CacheLineSize) std::atomic<uint32_t> m_WriterActive{ 0 };
+    HybridMutex m_WriterMutex;
+
+public:
+    TRWLock() = default;
+    TRWLock(const TRWLock&) = delete;
+    TRWLock& operator=(const TRWLock&) = delete;
+
+    void lock_shared() noexcept
+    {
+        std::atomic<uint32_t>& readers = CurrentSlot().Readers;
+        for (;;)
+        {
+            // Dekker with lock(): announce ourselves, then check for a writer; the writer does the opposite.
+            readers.fetch_add(1, std::memory_order_seq_cst);
+            if (m_WriterActive.load(std::memory_order_seq_cst) == 0)
+            {
+                return;
+            }
+            ReleaseSlot(readers);
+            m_WriterActive.wait(1, std::memory_order_acquire);
+        }
+    }
+    bool try_lock_shared() noexcept
+    {
+        std::atomic<uint32_t>& readers = CurrentSlot().Readers;
+        readers.fetch_add(1, std::memory_order_seq_cst);
+        if (m_WriterActive.load(std::memory_order_seq_cst) == 0)
+        {
+            return true;
+        }
+        ReleaseSlot(readers);
+        return false;
+    }
+    void unlock_shared() noexcept { ReleaseSlot(CurrentSlot().Readers); }
+
+    void lock() noexcept
+    {
+        m_WriterMutex.lock();
+        m_WriterActive.store(1, std::memory_order_seq_cst);
+        for (Slot& slot : m_Slots)
+        {
+            for (uint32_t readers = slot.Readers.load(std::memory_order_seq_cst); readers != 0;
+                 readers = slot.Readers.load(std::memory_order_seq_cst))
+            {
+                slot.Readers.wait(readers, std::memory_order_seq_cst);
+            }
+        }
+    }
+    bool try_lock() noexcept
+    {
+        if (!m_WriterMutex.try_lock())
+        {
+            return false;
+        }
+        m_WriterActive.store(1, std::memory_order_seq_cst);
+        for (Slot& slot : m_Slots)
+        {
+            if (slot.Readers.load(std::memory_order_seq_cst) != 0)
+            {
+                Reopen();
+                return false;
+            }
+        }
+        return true;
+    }
+    void unlock() noexcept { Reopen(); }
+
+private:
+    // Threads are dealt slots round robin, a thread always uses the same one.
+    Slot& CurrentSlot() noexcept
+    {
+        static std::atomic<uint32_t> s_NextSlot{ 0 };
+        static thread_local uint32_t s_Slot = s_NextSlot.fetch_add(1, std::memory_order_relaxed) % ReaderSlots;
+        return m_Slots[s_Slot];
+    }
+
+    void ReleaseSlot(std::atomic<uint32_t>& readers) noexcept
+    {
+        readers.fetch_sub(1, std::memory_order_seq_cst);
+        if (m_WriterActive.load(std::memory_order_seq_cst) != 0)
+        {
+            readers.notify_all();
+        }
+    }
+
+    void Reopen() noexcept
+    {
+        m_WriterActive.store(0, std::memory_order_release);
+        m_WriterActive.notify_all();
+        m_WriterMutex.unlock();
+    }
+};
+using RWLock = TRWLock<>;
+
+/// <summary>
+/// Sequence lock for small read-mostly values. Readers never write shared memory: they copy the value and retry
+/// if a writer was active meanwhile. Writers are serialized by the sequence itself.
+/// The value is kept as relaxed atomic words, so the racing copy is well defined.
+/// </summary>
+/// <typeparam name="T"> Value Type, must be trivially copyable </typeparam>
+template<typename T>
+class alignas(g_CacheLineSize) TSeqLock
+{
+    static_assert(std::is_trivially_copyable_v<T>, "TSeqLock copies the value bytewise.");
+
+private:
+    static constexpr size_t s_WordCount = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint64_t> m_Sequence{ 0 };    // odd while a write is in progress
+    std::atomic<uint64_t> m_Words[s_WordCount]{};
+
+public:
+    TSeqLock() { Store(T{}); }
+    explicit TSeqLock(In<T> value) { Store(value); }
+    TSeqLock(const TSeqLock&) = delete;
+    TSeqLock& operator=(const TSeqLock&) = delete;
+
+    T Read() const noexcept
+    {
+        for (;;)
+        {
+            uint64_t before = m_Sequence.load(std::memory_order_acquire);
+            if ((before & 1) != 0)
+            {
+                Platform::CpuPause();
+                continue;
+            }
+            T value = Load();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (m_Sequence.load(std::memory_order_relaxed) == before)
+            {
+                return value;
+            }
+        }
+    }
+
+    void Write(In<T> value) noexcept
+    {
+        uint64_t sequence = BeginWrite();
+        Store(value);
+        m_Sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    /// <summary>
+    /// Read-modify-write under the write side, fn gets a T&. If fn throws the value is left unchanged.
+    /// </summary>
+    template<typename Fn>
+    void Update(Fn&& fn)
+    {
+        uint64_t sequence = BeginWrite();
+        T value = Load();
+        try
+        {
+            fn(value);
+        } catch (...)
+        {
+            // Nothing was stored, but the sequence must go even again or every later reader and writer spins forever.
+            m_Sequence.store(sequence + 2, std::memory_order_release);
+            throw;
+        }
+        Store(value);
+        m_Sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+private:
+    // Make the sequence odd, returns the even value it had.
+    uint64_t BeginWrite() noexcept
+    {
+        uint64_t sequence = m_Sequence.load(std::memory_order_relaxed);
+        while ((sequence & 1) != 0
+               || !m_Sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            Platform::CpuPause();
+            sequence = m_Sequence.load(std::memory_order_relaxed);
+        }
+        // Keep the word stores after the odd sequence becomes visible.
+        std::atomic_thread_fence(std::memory_order_release);
+        return sequence;
+    }
+
+    T Load() const noexcept
+    {
+        uint64_t words[s_WordCount];
+        for (size_t i = 0; i < s_WordCount; ++i)
+        {
+            words[i] = m_Words[i].load(std::memory_order_relaxed);
+        }
+        T value;
+        std::memcpy(&value, words, sizeof(T));
+        return value;
+    }
+    void Store(In<T> value) noexcept
+    {
+        uint64_t words[s_WordCount]{};
+        std::memcpy(words, &value, sizeof(T));
+        for (size_t i = 0; i < s_WordCount; ++i)
+        {
+            m_Words[i].store(words[i], std::memory_order_relaxed);
+        }
+    }
+};
+}
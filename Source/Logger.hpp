@@ -0,0 +1,619 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+#include "String.hpp"
+#include "Singleton.hpp"
+
+// SLog(Info, "loaded {} assets in {} ms", count, ms). The format is a string literal, its {} are replaced in order.
+#define SLog(level, format, ...) Snowy::Logger::Log<Snowy::LogLevel::level, Snowy::FixedString(format)>(__VA_ARGS__)
+
+namespace Snowy
+{
+enum class LogLevel : uint8_t
+{
+    Trace,
+    Debug,
+    Info,
+    Warning,
+    Error,
+    Fatal,
+};
+
+enum class LogEncoding : uint8_t
+{
+    Utf8,
+    Ansi,
+};
+
+struct LoggerDesc
+{
+    // Per-thread ring size, applies to threads that log for the first time after Configure.
+    size_t ThreadBufferBytes = size_t(1) << 18;
+    // How often the background thread formats and writes what was logged.
+    std::chrono::milliseconds DrainInterval = std::chrono::milliseconds(2);
+    // What wide string arguments are converted to.
+    LogEncoding Encoding = LogEncoding::Utf8;
+    // Wait for the background thread when a thread's ring is full instead of dropping the record.
+    bool BlockWhenFull = false;
+};
+
+// Receives one formatted line, without the line break.
+using LogSink = std::function<void(LogLevel, AnsiStringIn)>;
+
+namespace Detail
+{
+// -------------------------------------------------------------
+// Argument Encoding
+// -------------------------------------------------------------
+
+// TLogArg<T> copies an argument into the ring (Size / Write on the logging thread) and reads it back and appends it
+// to the line (Read / Append on the background thread). Strings are copied, so the caller's buffer may go away.
+template<typename T, typename = void>
+struct TLogArg
+{
+    static_assert(sizeof(T) == 0, "SLog argument type is not supported.");
+};
+
+template<typename T>
+struct TLogArg<T, std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_pointer_v<T>>>
+{
+    using Decoded = T;
+
+    static size_t Size(T) noexcept { return sizeof(T); }
+    static void Write(std::byte*& cursor, T value) noexcept
+    {
+        std::memcpy(cursor, &value, sizeof(T));
+        cursor += sizeof(T);
+    }
+    static Decoded Read(const std::byte*& cursor) noexcept
+    {
+        T value;
+        std::memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return value;
+    }
+    static void Append(AnsiString& out, const void* decoded, LogEncoding)
+    {
+        T value = *static_cast<const T*>(decoded);
+        char buffer[64];
+        char* end = buffer;
+        if constexpr (std::is_same_v<T, bool>)
+        {
+            out.append(value ? "true" : "false");
+            return;
+        } else if constexpr (std::is_same_v<T, char>)
+        {
+            out.push_back(value);
+            return;
+        } else if constexpr (std::is_enum_v<T>)
+        {
+            end = std::to_chars(buffer, buffer + sizeof(buffer), static_cast<std::underlying_type_t<T>>(value)).ptr;
+        } else if constexpr (std::is_pointer_v<T>)
+        {
+            out.append("0x");
+            end = std::to_chars(buffer, buffer + sizeof(buffer), reinterpret_cast<uintptr_t>(value), 16).ptr;
+        } else
+        {
+            end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+        }
+        out.append(buffer, end);
+    }
+};
+
+template<typename CharT>
+struct TLogStringArg
+{
+    using Decoded = std::basic_string_view<CharT>;
+
+    static size_t Size(Decoded value) noexcept { return sizeof(uint32_t) + value.size() * sizeof(CharT); }
+    static void Write(std::byte*& cursor, Decoded value) noexcept
+    {
+        uint32_t length = static_cast<uint32_t>(value.size());
+        std::memcpy(cursor, &length, sizeof(length));
+        std::memcpy(cursor + sizeof(length), value.data(), value.size() * sizeof(CharT));
+        cursor += Size(value);
+    }
+    static Decoded Read(const std::byte*& cursor) noexcept
+    {
+        uint32_t length;
+        std::memcpy(&length, cursor, sizeof(length));
+        // The ring only guarantees 8 byte alignment, wide strings are read through a copy in Append.
+        Decoded value(reinterpret_cast<const CharT*>(cursor + sizeof(length)), length);
+        cursor += sizeof(length) + length * sizeof(CharT);
+        return value;
+    }
+    static void Append(AnsiString& out, const void* decoded, LogEncoding encoding)
+    {
+        Decoded value = *static_cast<const Decoded*>(decoded);
+        if constexpr (std::is_same_v<CharT, AnsiChar>)
+        {
+            out.append(value);
+        } else
+        {
+            WideString wide(value.size(), WideChar(0));
+            std::memcpy(wide.data(), value.data(), value.size() * sizeof(WideChar));
+            out.append(encoding == LogEncoding::Utf8 ? StringConvertor::WideToUtf8(wide) : StringConvertor::WideToAnsi(wide));
+        }
+    }
+};
+
+template<typename T>
+struct TLogArg<T, std::enable_if_t<std::is_convertible_v<const T&, AnsiStringView> && !std::is_pointer_v<T>>> : TLogStringArg<AnsiChar> {};
+template<typename T>
+struct TLogArg<T, std::enable_if_t<std::is_convertible_v<const T&, WideStringView> && !std::is_pointer_v<T>>> : TLogStringArg<WideChar> {};
+template<>
+struct TLogArg<const AnsiChar*> : TLogStringArg<AnsiChar> {};
+template<>
+struct TLogArg<AnsiChar*> : TLogStringArg<AnsiChar> {};
+template<>
+struct TLogArg<const WideChar*> : TLogStringArg<WideChar> {};
+template<>
+struct TLogArg<WideChar*> : TLogStringArg<WideChar> {};
+
+// -------------------------------------------------------------
+// Records
+// -------------------------------------------------------------
+
+struct LogSite;
+using LogFormatFn = void (*)(const LogSite& site, const std::byte* payload, AnsiString& out, LogEncoding encoding);
+
+// One per SLog format and argument types, its address is the format id carried by every record.
+struct LogSite
+{
+    const char* Format;
+    LogLevel Level;
+    LogFormatFn FormatFn;
+};
+
+struct LogRecordHeader
+{
+    const LogSite* Site;    // nullptr marks the padding before a wrap
+    uint64_t Ticks;
+    uint32_t Size;          // header and payload, a multiple of 8
+};
+
+using LogAppendFn = void (*)(AnsiString& out, const void* decoded, LogEncoding encoding);
+
+// Replace each {} of format with the next argument, {{ and }} are literal braces.
+inline void AppendFormatted(AnsiString& out, const char* format, ArrayIn<const void*> args, ArrayIn<LogAppendFn> appends,
+                            LogEncoding encoding)
+{
+    size_t next = 0;
+    for (const char* c = format; *c != '\0'; ++c)
+    {
+        if (c[0] == '{' && c[1] == '}' && next < args.size())
+        {
+            appends[next](out, args[next], encoding);
+            ++next;
+            ++c;
+        } else if ((c[0] == '{' && c[1] == '{') || (c[0] == '}' && c[1] == '}'))
+        {
+            out.push_back(c[0]);
+            ++c;
+        } else
+        {
+            out.push_back(c[0]);
+        }
+    }
+}
+
+template<typename... Args>
+void FormatRecord(const LogSite& site, const std::byte* payload, AnsiString& out, LogEncoding encoding)
+{
+    if constexpr (sizeof...(Args) == 0)
+    {
+        AppendFormatted(out, site.Format, {}, {}, encoding);
+    } else
+    {
+        // Braced initialization reads the arguments left to right.
+        std::tuple<typename TLogArg<Args>::Decoded...> decoded{ TLogArg<Args>::Read(payload)... };
+        std::apply([&](const auto&... values) {
+            const void* args[] = { static_cast<const void*>(&values)... };
+            const LogAppendFn appends[] = { &TLogArg<Args>::Append... };
+            AppendFormatted(out, site.Format, args, appends, encoding);
+        }, decoded);
+    }
+}
+
+template<LogLevel Level, FixedString Format, typename... Args>
+struct TLogSite
+{
+    static constexpr LogSite s_Site{ Format.buffer, Level, &FormatRecord<Args...> };
+};
+}
+
+/// <summary>
+/// Asynchronous logger. A call site copies its raw arguments and a pointer to its static format site into a per-thread
+/// ring, formatting, wide string conversion and writing happen on a background thread. Lines from different threads
+/// are ordered by time stamp within each drain. Stop the threads that log before SingletonRegistry::Shutdown, a record
+/// logged after it is dropped rather than constructing a new Logger.
+/// </summary>
+class Logger : public TSingleton<Logger>
+{
+    friend class TSingleton<Logger>;
+
+private:
+    // Single producer byte ring of variable sized records, see LogRecordHeader.
+    struct ThreadBuffer
+    {
+        UniqueHandle<std::byte[]> Bytes;
+        size_t Capacity;
+        uint32_t ThreadId;
+        alignas(g_CacheLineSize) std::atomic<size_t> Head{ 0 };
+        size_t CachedTail = 0;
+        std::atomic<uint64_t> Dropped{ 0 };
+        std::atomic<bool> Exited{ false };
+        alignas(g_CacheLineSize) std::atomic<size_t> Tail{ 0 };
+
+        ThreadBuffer(size_t capacity, uint32_t threadId)
+            : Bytes(MakeUnique<std::byte[]>(std::bit_ceil(std::max<size_t>(capacity, 256))))
+            , Capacity(std::bit_ceil(std::max<size_t>(capacity, 256)))
+            , ThreadId(threadId)
+        {}
+
+        // Room for size contiguous bytes, or nullptr when the ring is full. Publish with Commit.
+        std::byte* Reserve(size_t size, size_t& head) noexcept
+        {
+            head = Head.load(std::memory_order_relaxed);
+            size_t offset = head & (Capacity - 1);
+            size_t padding = Capacity - offset < size ? Capacity - offset : 0;
+            if (size > Capacity || !HasRoom(head, padding + size))
+            {
+                return nullptr;
+            }
+            if (padding != 0)
+            {
+                std::memset(&Bytes[offset], 0, sizeof(Detail::LogRecordHeader::Site));
+                head += padding;
+                offset = 0;
+            }
+            return &Bytes[offset];
+        }
+        void Commit(size_t head, size_t size) noexcept { Head.store(head + size, std::memory_order_release); }
+
+        bool HasRoom(size_t head, size_t size) noexcept
+        {
+            if (Capacity - (head - CachedTail) >= size)
+            {
+                return true;
+            }
+            CachedTail = Tail.load(std::memory_order_acquire);
+            return Capacity - (head - CachedTail) >= size;
+        }
+    };
+
+    struct ThreadExit
+    {
+        ~ThreadExit()
+        {
+            if (s_Buffer != nullptr && s_BufferEpoch == s_Epoch.load(std::memory_order_acquire))
+            {
+                s_Buffer->Exited.store(true, std::memory_order_release);
+            }
+            s_Buffer = nullptr;
+        }
+    };
+
+    struct PendingLine
+    {
+        uint64_t Ticks;
+        LogLevel Level;
+        size_t Offset;
+        size_t Length;
+    };
+
+    static inline std::atomic<LogLevel> s_MinLevel{ LogLevel::Info };
+    static inline std::atomic<bool> s_BlockWhenFull{ false };
+    // Bumped when a Logger goes away, a thread's s_Buffer from an earlier epoch belongs to a destroyed instance.
+    static inline std::atomic<uint32_t> s_Epoch{ 0 };
+    static inline thread_local ThreadBuffer* s_Buffer = nullptr;
+    static inline thread_local uint32_t s_BufferEpoch = 0;
+
+    std::mutex m_Mutex;
+    LoggerDesc m_Desc;
+    std::vector<UniqueHandle<ThreadBuffer>> m_Buffers;
+    uint32_t m_NextThreadId = 1;
+    uint64_t m_ExitedDropped = 0;   // drops of buffers already released
+    CycleCalibration m_Calibration;
+    std::chrono::system_clock::time_point m_TimeBase;
+
+    // Sinks run under m_WriteMutex only, so they may log, and threads logging for the first time don't wait on them.
+    // It's recursive for sinks that call Flush. Lock order is m_WriteMutex, then m_Mutex.
+    std::recursive_mutex m_WriteMutex;
+    std::vector<LogSink> m_Sinks;
+    AnsiString m_Text;
+    std::vector<PendingLine> m_Lines;
+
+    std::thread m_DrainThread;
+    std::condition_variable m_DrainWake;
+    bool m_StopDrain = false;
+
+protected:
+    Logger()
+    {
+        m_TimeBase = std::chrono::system_clock::now();
+        m_Calibration = CycleCalibration::Measure();
+        m_DrainThread = std::thread([this] { DrainLoop(); });
+    }
+    ~Logger()
+    {
+        s_Epoch.fetch_add(1, std::memory_order_acq_rel);
+        {
+            std::lock_guard lock(m_Mutex);
+            m_StopDrain = true;
+        }
+        m_DrainWake.notify_one();
+        m_DrainThread.join();
+        Drain();
+    }
+
+public:
+    template<LogLevel Level, FixedString Format, typename... Args>
+    static void Log(const Args&... args)
+    {
+        static_assert(std::is_same_v<typename SDecayOf(Format)::CharType, char>, "Log formats are narrow strings.");
+        if (Level < s_MinLevel.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+        using Site = Detail::TLogSite<Level, Format, std::decay_t<Args>...>;
+        size_t payload = (Detail::TLogArg<std::decay_t<Args>>::Size(args) + ... + size_t(0));
+        size_t size = (sizeof(Detail::LogRecordHeader) + payload + 7) & ~size_t(7);
+
+        ThreadBuffer* buffer = s_Buffer;
+        if (buffer == nullptr || s_BufferEpoch != s_Epoch.load(std::memory_order_relaxed)) [[unlikely]]
+        {
+            buffer = AttachBuffer();
+            if (buffer == nullptr)
+            {
+                return;
+            }
+        }
+        size_t head;
+        std::byte* record = buffer->Reserve(size, head);
+        while (record == nullptr) [[unlikely]]
+        {
+            if (!s_BlockWhenFull.load(std::memory_order_relaxed) || size > buffer->Capacity)
+            {
+                buffer->Dropped.store(buffer->Dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return;
+            }
+            if (!IsInitialized())
+            {
+                return;
+            }
+            GetInstance().m_DrainWake.notify_one();
+            std::this_thread::yield();
+            record = buffer->Reserve(size, head);
+        }
+        Detail::LogRecordHeader header{ &Site::s_Site, Platform::CycleCounter(), static_cast<uint32_t>(size) };
+        std::memcpy(record, &header, sizeof(header));
+        [[maybe_unused]] std::byte* cursor = record + sizeof(header);
+        (Detail::TLogArg<std::decay_t<Args>>::Write(cursor, args), ...);
+        buffer->Commit(head, size);
+    }
+
+    static void SetLevel(LogLevel level) noexcept { s_MinLevel.store(level, std::memory_order_relaxed); }
+    static LogLevel GetLevel() noexcept { return s_MinLevel.load(std::memory_order_relaxed); }
+
+    void Configure(In<LoggerDesc> desc)
+    {
+        std::lock_guard lock(m_Mutex);
+        m_Desc = desc;
+        s_BlockWhenFull.store(desc.BlockWhenFull, std::memory_order_relaxed);
+    }
+
+    /// <summary>
+    /// Add an output, with no sink lines go to stdout. Sinks may log and Flush, but not add sinks.
+    /// </summary>
+    void AddSink(LogSink sink)
+    {
+        std::lock_guard lock(m_WriteMutex);
+        m_Sinks.push_back(std::move(sink));
+    }
+
+    /// <summary>
+    /// Format and write everything logged so far, e.g. before a crash handler exits.
+    /// </summary>
+    void Flush()
+    {
+        Drain();
+    }
+
+    /// <summary>
+    /// Records dropped because a thread's ring was full.
+    /// </summary>
+    uint64_t DroppedCount()
+    {
+        std::lock_guard lock(m_Mutex);
+        uint64_t dropped = m_ExitedDropped;
+        for (auto& buffer : m_Buffers)
+        {
+            dropped += buffer->Dropped.load(std::memory_order_relaxed);
+        }
+        return dropped;
+    }
+
+private:
+    // Cold path of Log. The first record ever constructs the Logger, but one logged after Shutdown must not bring it back.
+    static ThreadBuffer* AttachBuffer()
+    {
+        if (!IsInitialized() && s_Epoch.load(std::memory_order_acquire) != 0)
+        {
+            SAssert(!"Logged after SingletonRegistry::Shutdown, stop logging threads first.");
+            return nullptr;
+        }
+        return GetInstance().CurrentBuffer();
+    }
+
+    ThreadBuffer* CurrentBuffer()
+    {
+        uint32_t epoch = s_Epoch.load(std::memory_order_acquire);
+        if (s_Buffer == nullptr || s_BufferEpoch != epoch)
+        {
+            static thread_local ThreadExit s_ThreadExit;
+            (void)s_ThreadExit;
+            std::lock_guard lock(m_Mutex);
+            m_Buffers.push_back(MakeUnique<ThreadBuffer>(m_Desc.ThreadBufferBytes, m_NextThreadId++));
+            s_Buffer = m_Buffers.back().get();
+            s_BufferEpoch = epoch;
+        }
+        return s_Buffer;
+    }
+
+    void DrainLoop()
+    {
+        std::unique_lock lock(m_Mutex);
+        while (!m_StopDrain)
+        {
+            m_DrainWake.wait_for(lock, m_Desc.DrainInterval);
+            lock.unlock();
+            Drain();
+            lock.lock();
+        }
+    }
+
+    // Format under m_Mutex, then hand the lines to the sinks with only m_WriteMutex held.
+    void Drain()
+    {
+        std::lock_guard writeLock(m_WriteMutex);
+        AnsiString text;
+        std::vector<PendingLine> lines;
+        {
+            std::lock_guard lock(m_Mutex);
+            CollectLocked();
+            std::swap(text, m_Text);
+            std::swap(lines, m_Lines);
+        }
+        WriteLines(text, lines);
+        // Keep the larger buffers for the next drain, a sink calling Flush may have left its own behind.
+        if (text.capacity() > m_Text.capacity())
+        {
+            std::swap(text, m_Text);
+        }
+        if (lines.capacity() > m_Lines.capacity())
+        {
+            std::swap(lines, m_Lines);
+        }
+    }
+
+    void CollectLocked()
+    {
+        m_Text.clear();
+        m_Lines.clear();
+        for (auto it = m_Buffers.begin(); it != m_Buffers.end();)
+        {
+            ThreadBuffer& buffer = **it;
+            // Exited is read first, so nothing can be logged after the drain below empties the buffer.
+            bool exited = buffer.Exited.load(std::memory_order_acquire);
+            DrainBuffer(buffer);
+            if (exited)
+            {
+                m_ExitedDropped += buffer.Dropped.load(std::memory_order_relaxed);
+                it = m_Buffers.erase(it);
+            } else
+            {
+                ++it;
+            }
+        }
+        std::stable_sort(m_Lines.begin(), m_Lines.end(), [](const PendingLine& a, const PendingLine& b) { return a.Ticks < b.Ticks; });
+    }
+
+    void WriteLines(AnsiStringIn text, ArrayIn<PendingLine> lines)
+    {
+        for (const PendingLine& line : lines)
+        {
+            AnsiStringIn lineText = text.substr(line.Offset, line.Length);
+            if (m_Sinks.empty())
+            {
+                std::fwrite(lineText.data(), 1, lineText.size(), stdout);
+                std::fputc('\n', stdout);
+            }
+            for (LogSink& sink : m_Sinks)
+            {
+                sink(line.Level, lineText);
+            }
+        }
+        if (m_Sinks.empty() && !lines.empty())
+        {
+            std::fflush(stdout);
+        }
+    }
+
+    void DrainBuffer(ThreadBuffer& buffer)
+    {
+        size_t tail = buffer.Tail.load(std::memory_order_relaxed);
+        size_t head = buffer.Head.load(std::memory_order_acquire);
+        while (tail != head)
+        {
+            size_t offset = tail & (buffer.Capacity - 1);
+            const std::byte* record = &buffer.Bytes[offset];
+            Detail::LogRecordHeader header;
+            std::memcpy(&header.Site, record, sizeof(header.Site));
+            if (header.Site == nullptr)
+            {
+                tail += buffer.Capacity - offset;
+                continue;
+            }
+            std::memcpy(&header, record, sizeof(header));
+            size_t start = m_Text.size();
+            AppendPrefix(header, buffer.ThreadId);
+            header.Site->FormatFn(*header.Site, record + sizeof(header), m_Text, m_Desc.Encoding);
+            m_Lines.push_back({ header.Ticks, header.Site->Level, start, m_Text.size() - start });
+            tail += header.Size;
+        }
+        buffer.Tail.store(tail, std::memory_order_release);
+    }
+
+    // "2026-01-31T12:00:00.123456Z Info    [T1] "
+    void AppendPrefix(const Detail::LogRecordHeader& header, uint32_t threadId)
+    {
+        using namespace std::chrono;
+        double elapsed = header.Ticks >= m_Calibration.TickBase
+            ? double(header.Ticks - m_Calibration.TickBase) * m_Calibration.NanosecondsPerTick
+            : -double(m_Calibration.TickBase - header.Ticks) * m_Calibration.NanosecondsPerTick;
+        auto time = time_point_cast<microseconds>(m_TimeBase) + microseconds(int64_t(elapsed / 1000.0));
+        auto day = floor<days>(time);
+        year_month_day date(day);
+        hh_mm_ss<microseconds> clock(time - day);
+        char buffer[64];
+        int length = std::snprintf(buffer, sizeof(buffer), "%04d-%02u-%02uT%02d:%02d:%02d.%06lldZ %-7s [T%u] ",
+                                   int(date.year()), unsigned(date.month()), unsigned(date.day()), int(clock.hours().count()),
+                                   int(clock.minutes().count()), int(clock.seconds().count()),
+                                   static_cast<long long>(clock.subseconds().count()), LevelName(header.Site->Level), threadId);
+        m_Text.append(buffer, size_t(std::max(length, 0)));
+    }
+
+    static const char* LevelName(LogLevel level) noexcept
+    {
+        switch (level)
+        {
+            case LogLevel::Trace: return "Trace";
+            case LogLevel::Debug: return "Debug";
+            case LogLevel::Info: return "Info";
+            case LogLevel::Warning: return "Warning";
+            case LogLevel::Error: return "Error";
+            case LogLevel::Fatal: return "Fatal";
+        }
+        return "?";
+    }
+};
+}
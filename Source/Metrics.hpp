@@ -0,0 +1,422 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+#include "String.hpp"
+#include "Singleton.hpp"
+#include "ShardedCounter.hpp"
+
+namespace Snowy
+{
+// -------------------------------------------------------------
+// Histogram
+// -------------------------------------------------------------
+
+/// <summary>
+/// Counts of a THdrHistogram at one point in time. Snapshots of histograms with the same SubBucketBits merge by adding
+/// bucket counts, so per-thread or per-process histograms can be combined without losing precision.
+/// </summary>
+struct HistogramSnapshot
+{
+    uint32_t SubBucketBits = 0;
+    std::vector<uint64_t> Counts;   // per bucket
+    uint64_t Count = 0;
+    uint64_t Sum = 0;
+    uint64_t Min = std::numeric_limits<uint64_t>::max();
+    uint64_t Max = 0;
+
+    // Smallest and largest value that fall into bucket index.
+    uint64_t BucketLowerBound(size_t index) const noexcept
+    {
+        uint64_t subBuckets = uint64_t(1) << SubBucketBits;
+        if (index < subBuckets)
+        {
+            return index;
+        }
+        uint32_t shift = uint32_t(index >> SubBucketBits) - 1;
+        return (subBuckets | (index & (subBuckets - 1))) << shift;
+    }
+    uint64_t BucketUpperBound(size_t index) const noexcept
+    {
+        uint64_t subBuckets = uint64_t(1) << SubBucketBits;
+        if (index < subBuckets)
+        {
+            return index;
+        }
+        uint32_t shift = uint32_t(index >> SubBucketBits) - 1;
+        return BucketLowerBound(index) + ((uint64_t(1) << shift) - 1);
+    }
+
+    double Mean() const noexcept { return Count != 0 ? double(Sum) / double(Count) : 0.0; }
+
+    /// <summary>
+    /// Value at quantile in [0, 1], exact to the bucket width (2^-SubBucketBits relative). Reports the bucket's upper
+    /// bound clamped to Max, so tail quantiles are never under-reported.
+    /// </summary>
+    uint64_t ValueAtQuantile(double quantile) const noexcept
+    {
+        if (Count == 0)
+        {
+            return 0;
+        }
+        uint64_t rank = std::max<uint64_t>(uint64_t(std::clamp(quantile, 0.0, 1.0) * double(Count) + 0.5), 1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < Counts.size(); ++i)
+        {
+            seen += Counts[i];
+            if (seen >= rank)
+            {
+                return std::clamp(BucketUpperBound(i), Min, Max);
+            }
+        }
+        return Max;
+    }
+
+    void Merge(const HistogramSnapshot& other)
+    {
+        SAssert(other.Counts.empty() || Counts.empty() || SubBucketBits == other.SubBucketBits);
+        if (Counts.empty())
+        {
+            SubBucketBits = other.SubBucketBits;
+            Counts.resize(other.Counts.size());
+        }
+        for (size_t i = 0; i < other.Counts.size(); ++i)
+        {
+            Counts[i] += other.Counts[i];
+        }
+        Count += other.Count;
+        Sum += other.Sum;
+        Min = std::min(Min, other.Min);
+        Max = std::max(Max, other.Max);
+    }
+};
+
+/// <summary>
+/// Log-linear histogram over uint64_t values, e.g. latencies in nanoseconds. Values below 2^SubBucketBits get a bucket
+/// each, every power of two above is split into 2^SubBucketBits linear buckets, so relative error is bounded by
+/// 2^-SubBucketBits over the whole range at a fixed, allocation-free footprint. Record is lock-free, a relaxed
+/// fetch_add on the bucket and on the sharded sum.
+/// </summary>
+/// <typeparam name="SubBucketBits"> Linear Buckets Per Power Of Two, As Bits </typeparam>
+template<uint32_t SubBucketBits = 5>
+class THdrHistogram
+{
+    static_assert(SubBucketBits >= 1 && SubBucketBits <= 16, "SubBucketBits out of range.");
+
+public:
+    static constexpr size_t s_SubBucketCount = size_t(1) << SubBucketBits;
+    static constexpr size_t s_BucketCount = (64 - SubBucketBits + 1) * s_SubBucketCount;
+
+private:
+    UniqueHandle<std::atomic<uint64_t>[]> m_Counts;
+    TShardedCounter<uint64_t> m_Sum;
+    alignas(g_CacheLineSize) std::atomic<uint64_t> m_Min{ std::numeric_limits<uint64_t>::max() };
+    std::atomic<uint64_t> m_Max{ 0 };
+
+public:
+    THdrHistogram() : m_Counts(MakeUnique<std::atomic<uint64_t>[]>(s_BucketCount)) {}
+    THdrHistogram(const THdrHistogram&) = delete;
+    THdrHistogram& operator=(const THdrHistogram&) = delete;
+
+    static constexpr size_t BucketIndex(uint64_t value) noexcept
+    {
+        if (value < s_SubBucketCount)
+        {
+            return size_t(value);
+        }
+        uint32_t shift = uint32_t(std::bit_width(value)) - SubBucketBits - 1;
+        return ((size_t(shift) + 1) << SubBucketBits) | size_t((value >> shift) & (s_SubBucketCount - 1));
+    }
+
+    void Record(uint64_t value) noexcept
+    {
+        m_Counts[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        m_Sum.Add(value);
+        // Only the first samples and new extremes write.
+        for (uint64_t min = m_Min.load(std::memory_order_relaxed);
+             value < min && !m_Min.compare_exchange_weak(min, value, std::memory_order_relaxed);)
+        {
+        }
+        for (uint64_t max = m_Max.load(std::memory_order_relaxed);
+             value > max && !m_Max.compare_exchange_weak(max, value, std::memory_order_relaxed);)
+        {
+        }
+    }
+    template<typename Rep, typename Period>
+    void Record(std::chrono::duration<Rep, Period> duration) noexcept
+    {
+        auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+        Record(uint64_t(std::max<decltype(nanoseconds)>(nanoseconds, 0)));
+    }
+
+    /// <summary>
+    /// Relaxed copy, samples recorded concurrently may be partially included.
+    /// </summary>
+    HistogramSnapshot Snapshot() const
+    {
+        HistogramSnapshot snapshot;
+        snapshot.SubBucketBits = SubBucketBits;
+        snapshot.Counts.resize(s_BucketCount);
+        for (size_t i = 0; i < s_BucketCount; ++i)
+        {
+            snapshot.Counts[i] = m_Counts[i].load(std::memory_order_relaxed);
+            snapshot.Count += snapshot.Counts[i];
+        }
+        snapshot.Sum = m_Sum.Read();
+        snapshot.Min = m_Min.load(std::memory_order_relaxed);
+        snapshot.Max = m_Max.load(std::memory_order_relaxed);
+        return snapshot;
+    }
+
+    void Reset() noexcept
+    {
+        for (size_t i = 0; i < s_BucketCount; ++i)
+        {
+            m_Counts[i].store(0, std::memory_order_relaxed);
+        }
+        m_Sum.Reset();
+        m_Min.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+        m_Max.store(0, std::memory_order_relaxed);
+    }
+};
+using HdrHistogram = THdrHistogram<>;
+
+// -------------------------------------------------------------
+// Counter / Gauge
+// -------------------------------------------------------------
+
+// Monotonic count, sharded so hot increments don't share a cache line.
+using MetricCounter = TShardedCounter<uint64_t>;
+
+/// <summary>
+/// Value that goes up and down, e.g. queue depth or pool size.
+/// </summary>
+class MetricGauge
+{
+private:
+    std::atomic<double> m_Value{ 0.0 };
+
+public:
+    void Set(double value) noexcept { m_Value.store(value, std::memory_order_relaxed); }
+    void Add(double delta) noexcept { m_Value.fetch_add(delta, std::memory_order_relaxed); }
+    double Read() const noexcept { return m_Value.load(std::memory_order_relaxed); }
+};
+
+// -------------------------------------------------------------
+// Registry
+// -------------------------------------------------------------
+
+struct MetricsSnapshot
+{
+    template<typename T>
+    struct TEntry
+    {
+        AnsiString Name;
+        T Value;
+    };
+
+    std::vector<TEntry<uint64_t>> Counters;
+    std::vector<TEntry<double>> Gauges;
+    std::vector<TEntry<HistogramSnapshot>> Histograms;
+
+    /// <summary>
+    /// Fold other in by name: counters and histograms add up, gauges add up too, e.g. per-process totals.
+    /// </summary>
+    void Merge(const MetricsSnapshot& other)
+    {
+        MergeEntries(Counters, other.Counters, [](uint64_t& into, uint64_t from) { into += from; });
+        MergeEntries(Gauges, other.Gauges, [](double& into, double from) { into += from; });
+        MergeEntries(Histograms, other.Histograms, [](HistogramSnapshot& into, const HistogramSnapshot& from) { into.Merge(from); });
+    }
+
+private:
+    template<typename T, typename Fn>
+    static void MergeEntries(std::vector<TEntry<T>>& into, const std::vector<TEntry<T>>& from, Fn merge)
+    {
+        for (const TEntry<T>& entry : from)
+        {
+            auto it = std::find_if(into.begin(), into.end(), [&](const TEntry<T>& existing) { return existing.Name == entry.Name; });
+            if (it != into.end())
+            {
+                merge(it->Value, entry.Value);
+            } else
+            {
+                into.push_back(entry);
+            }
+        }
+    }
+};
+
+/// <summary>
+/// Process wide metric registry. Metrics are named by a FixedString template argument, e.g.
+/// MetricsRegistry::Counter<"http_requests_total">().Increment(). Each name is registered once, on first use,
+/// after that a lookup is a function static access.
+/// </summary>
+class MetricsRegistry : public TSingleton<MetricsRegistry>
+{
+    friend class TSingleton<MetricsRegistry>;
+
+private:
+    template<typename T>
+    struct TEntry
+    {
+        const char* Name;
+        T* Metric;
+    };
+
+    std::mutex m_Mutex;
+    std::vector<TEntry<MetricCounter>> m_Counters;
+    std::vector<TEntry<MetricGauge>> m_Gauges;
+    std::vector<TEntry<HdrHistogram>> m_Histograms;
+
+protected:
+    MetricsRegistry() = default;
+
+public:
+    template<FixedString Name>
+    static MetricCounter& Counter()
+    {
+        static MetricCounter& s_Counter = GetInstance().Register<Name>(GetInstance().m_Counters);
+        return s_Counter;
+    }
+    template<FixedString Name>
+    static MetricGauge& Gauge()
+    {
+        static MetricGauge& s_Gauge = GetInstance().Register<Name>(GetInstance().m_Gauges);
+        return s_Gauge;
+    }
+    template<FixedString Name>
+    static HdrHistogram& Histogram()
+    {
+        static HdrHistogram& s_Histogram = GetInstance().Register<Name>(GetInstance().m_Histograms);
+        return s_Histogram;
+    }
+
+    MetricsSnapshot Snapshot()
+    {
+        std::lock_guard lock(m_Mutex);
+        MetricsSnapshot snapshot;
+        for (const auto& entry : m_Counters)
+        {
+            snapshot.Counters.push_back({ entry.Name, entry.Metric->Read() });
+        }
+        for (const auto& entry : m_Gauges)
+        {
+            snapshot.Gauges.push_back({ entry.Name, entry.Metric->Read() });
+        }
+        for (const auto& entry : m_Histograms)
+        {
+            snapshot.Histograms.push_back({ entry.Name, entry.Metric->Snapshot() });
+        }
+        return snapshot;
+    }
+
+    /// <summary>
+    /// Append every metric in Prometheus text exposition format to out.
+    /// </summary>
+    void WritePrometheus(AnsiString& out) { WritePrometheus(Snapshot(), out); }
+
+    static void WritePrometheus(const MetricsSnapshot& snapshot, AnsiString& out)
+    {
+        for (const auto& entry : snapshot.Counters)
+        {
+            WriteType(out, entry.Name, "counter");
+            WriteSample(out, entry.Name, {}, entry.Value);
+        }
+        for (const auto& entry : snapshot.Gauges)
+        {
+            WriteType(out, entry.Name, "gauge");
+            WriteSample(out, entry.Name, {}, entry.Value);
+        }
+        for (const auto& entry : snapshot.Histograms)
+        {
+            WriteHistogram(out, entry.Name, entry.Value);
+        }
+    }
+
+private:
+    // Metrics live until exit, references handed out in function statics must never dangle.
+    template<FixedString Name, typename T>
+    T& Register(std::vector<TEntry<T>>& entries)
+    {
+        static_assert(std::is_same_v<typename SDecayOf(Name)::CharType, char>, "Metric names are narrow strings.");
+        std::lock_guard lock(m_Mutex);
+        for (const auto& entry : entries)
+        {
+            if (AnsiStringIn(entry.Name) == AnsiStringIn(Name.buffer))
+            {
+                return *entry.Metric;
+            }
+        }
+        T* metric = new T();
+        entries.push_back({ Name.buffer, metric });
+        return *metric;
+    }
+
+    static void WriteType(AnsiString& out, AnsiStringIn name, AnsiStringIn type)
+    {
+        out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+    }
+
+    template<typename T>
+    static void WriteNumber(AnsiString& out, T value)
+    {
+        char buffer[32];
+        auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, end);
+    }
+
+    template<typename T>
+    static void WriteSample(AnsiString& out, AnsiStringIn name, AnsiStringIn le, T value)
+    {
+        out.append(name);
+        if (!le.empty())
+        {
+            out.append("{le=\"").append(le).append("\"}");
+        }
+        out.push_back(' ');
+        WriteNumber(out, value);
+        out.push_back('\n');
+    }
+
+    // Buckets are exported at the power of two boundaries between the smallest and largest sample, the log-linear
+    // buckets align with them so the cumulative counts are exact.
+    static void WriteHistogram(AnsiString& out, AnsiStringIn name, const HistogramSnapshot& histogram)
+    {
+        WriteType(out, name, "histogram");
+        AnsiString bucketName = AnsiString(name) + "_bucket";
+        if (histogram.Count != 0)
+        {
+            uint32_t first = uint32_t(std::bit_width(histogram.Min));
+            uint32_t last = uint32_t(std::bit_width(histogram.Max));
+            uint64_t cumulative = 0;
+            size_t bucket = 0;
+            for (uint32_t bits = first; bits <= last && bits < 64; ++bits)
+            {
+                uint64_t bound = (uint64_t(1) << bits) - 1;    // le is inclusive
+                for (; bucket < histogram.Counts.size() && histogram.BucketUpperBound(bucket) <= bound; ++bucket)
+                {
+                    cumulative += histogram.Counts[bucket];
+                }
+                char le[32];
+                auto [end, error] = std::to_chars(le, le + sizeof(le), bound);
+                WriteSample(out, bucketName, AnsiStringIn(le, end), cumulative);
+            }
+        }
+        WriteSample(out, bucketName, "+Inf", histogram.Count);
+        WriteSample(out, AnsiString(name) + "_sum", {}, histogram.Sum);
+        WriteSample(out, AnsiString(name) + "_count", {}, histogram.Count);
+    }
+};
+}
@@ -1,11 +1,18 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <thread>
 #include <type_traits>
 
+#include "Platform.hpp"
+
 #define SDecayOf(t) std::decay_t<decltype(t)>
 #define SNameOf(x) #x
+#define SConcatImpl(a, b) a ## b
+#define SConcat(a, b) SConcatImpl(a, b)
 
 #ifdef NDEBUG
 #define SAssert(expr)
@@ -15,4 +22,73 @@
 #define SStaticAssert(expr, msg) static_assert(expr, msg)
 #endif
 
-#define SSleep(_ms) std::this_thread::sleep_for(std::chrono::milliseconds(_ms));
\ No newline at end of file
+// Define SNOWY_CORE_PROFILE to record zones, otherwise SProfileScope expands to nothing.
+// TProfileScope comes from Profiler.hpp, include it (or SnowyCore.hpp) where zones are recorded.
+#if defined(SNOWY_CORE_PROFILE)
+#define SProfileScope(name) const Snowy::TProfileScope<Snowy::FixedString(name)> SConcat(_profileScope, __LINE__)
+#else
+#define SProfileScope(name)
+#endif
+
+#define SSleep(_ms) std::this_thread::sleep_for(std::chrono::milliseconds(_ms));
+
+namespace Snowy
+{
+/// <summary>
+/// Sleep until deadline without the scheduler quantum of oversleep: one sleep_for up to the deadline minus the expected
+/// oversleep (running mean + 1 sigma per thread), then spin out the short rest. Costs a core for that tail, so it's
+/// meant for the few waits that need sub-millisecond accuracy, SSleep stays a plain sleep.
+/// </summary>
+inline void PreciseSleepUntil(std::chrono::steady_clock::time_point deadline)
+{
+    using Clock = std::chrono::steady_clock;
+    // Welford's running mean and variance of how much longer than requested sleep_for takes, in seconds.
+    static thread_local double s_Margin = 2e-3;
+    static thread_local double s_Mean = 2e-3;
+    static thread_local double s_M2 = 0.0;
+    static thread_local uint64_t s_Count = 1;
+
+    Clock::time_point start = Clock::now();
+    double requested = std::chrono::duration<double>(deadline - start).count() - s_Margin;
+    if (requested > 0.0)
+    {
+        std::this_thread::sleep_for(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(requested)));
+        // A preempted outlier shouldn't turn every later call into a long spin.
+        double observed = std::clamp(std::chrono::duration<double>(Clock::now() - start).count() - requested, 0.0, 20e-3);
+        ++s_Count;
+        double delta = observed - s_Mean;
+        s_Mean += delta / static_cast<double>(s_Count);
+        s_M2 += delta * (observed - s_Mean);
+        s_Margin = s_Mean + std::sqrt(s_M2 / static_cast<double>(s_Count - 1));
+    }
+    while (Clock::now() < deadline)
+    {
+        Platform::CpuPause();
+    }
+}
+template<typename Rep, typename Period>
+inline void PreciseSleep(std::chrono::duration<Rep, Period> duration)
+{
+    PreciseSleepUntil(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration));
+}
+
+/// <summary>
+/// Rate of Platform::CycleCounter against steady_clock, measured over a short sleep, to turn tick stamps into time.
+/// </summary>
+struct CycleCalibration
+{
+    uint64_t TickBase = 0;      // ticks at the start of the measurement
+    double NanosecondsPerTick = 1.0;
+
+    static CycleCalibration Measure(std::chrono::milliseconds window = std::chrono::milliseconds(10))
+    {
+        using Clock = std::chrono::steady_clock;
+        Clock::time_point start = Clock::now();
+        uint64_t startTicks = Platform::CycleCounter();
+        PreciseSleep(window);
+        uint64_t endTicks = Platform::CycleCounter();
+        double nanoseconds = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        return { startTicks, nanoseconds / double(endTicks - startTicks) };
+    }
+};
+}
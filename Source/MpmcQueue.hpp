@@ -0,0 +1,345 @@
+﻿#pragma once
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <optional>
+#include <span>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+
+namespace Snowy
+{
+/// <summary>
+/// Bounded lock-free multi-producer/multi-consumer queue (Dmitry Vyukov's design).
+/// Every slot carries a sequence number telling whether it is ready for the producer or the consumer of a given lap.
+/// Works with move-only payloads such as UniqueHandle.
+/// </summary>
+/// <typeparam name="T"> Element Type </typeparam>
+template<typename T>
+class TMpmcQueue
+{
+public:
+    using ValueType = T;
+
+private:
+    static constexpr int s_SpinCount = 64;
+
+    struct Slot
+    {
+        std::atomic<size_t> Sequence;
+        alignas(T) std::byte Storage[sizeof(T)];
+
+        T* Get() noexcept { return std::launder(reinterpret_cast<T*>(Storage)); }
+    };
+    struct alignas(g_CacheLineSize) Cursor
+    {
+        std::atomic<size_t> Pos{ 0 };
+    };
+    struct alignas(g_CacheLineSize) WaitState
+    {
+        std::atomic<uint32_t> Event{ 0 };
+        std::atomic<uint32_t> Waiters{ 0 };
+    };
+
+    Cursor m_Enqueue;
+    Cursor m_Dequeue;
+    WaitState m_PushWait;   // consumers sleep here while the queue is empty
+    WaitState m_PopWait;    // producers sleep here while the queue is full
+    alignas(g_CacheLineSize) Slot* m_Slots;
+    size_t m_Mask;
+
+public:
+    /// <summary>
+    /// Capacity is rounded up to a power of two.
+    /// </summary>
+    explicit TMpmcQueue(size_t capacity)
+        : m_Mask(std::bit_ceil(capacity < 2 ? size_t(2) : capacity) - 1)
+    {
+        m_Slots = std::allocator<Slot>().allocate(m_Mask + 1);
+        for (size_t i = 0; i <= m_Mask; ++i)
+        {
+            ::new (static_cast<void*>(&m_Slots[i].Sequence)) std::atomic<size_t>(i);
+        }
+    }
+    TMpmcQueue(const TMpmcQueue&) = delete;
+    TMpmcQueue& operator=(const TMpmcQueue&) = delete;
+    ~TMpmcQueue()
+    {
+        size_t tail = m_Enqueue.Pos.load(std::memory_order_relaxed);
+        for (size_t head = m_Dequeue.Pos.load(std::memory_order_relaxed); head != tail; ++head)
+        {
+            std::destroy_at(m_Slots[head & m_Mask].Get());
+        }
+        std::allocator<Slot>().deallocate(m_Slots, m_Mask + 1);
+    }
+
+    size_t Capacity() const noexcept { return m_Mask + 1; }
+    // Approximate when other threads are working on the queue.
+    size_t Size() const noexcept
+    {
+        size_t tail = m_Enqueue.Pos.load(std::memory_order_acquire);
+        size_t head = m_Dequeue.Pos.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+    bool Empty() const noexcept { return Size() == 0; }
+
+    // -------------------------------------------------------------
+    // Producer
+    // -------------------------------------------------------------
+
+    template<typename... Args>
+    bool TryEmplace(Args&&... args)
+    {
+        size_t pos = m_Enqueue.Pos.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;)
+        {
+            slot = &m_Slots[pos & m_Mask];
+            size_t seq = slot->Sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (m_Enqueue.Pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            } else if (diff < 0)
+            {
+                return false;   // full
+            } else
+            {
+                pos = m_Enqueue.Pos.load(std::memory_order_relaxed);
+            }
+        }
+        ::new (static_cast<void*>(slot->Storage)) T(std::forward<Args>(args)...);
+        slot->Sequence.store(pos + 1, std::memory_order_release);
+        Signal(m_PushWait, 1);
+        return true;
+    }
+    bool TryPush(In<T> value) { return TryEmplace(value); }
+    bool TryPush(T&& value) { return TryEmplace(std::move(value)); }
+
+    /// <summary>
+    /// Claim a run of free slots with one CAS and copy items into it. Returns the count pushed, may be less than requested.
+    /// </summary>
+    size_t PushN(ArrayIn<T> items)
+    {
+        if (items.empty())
+        {
+            return 0;
+        }
+        size_t pos = m_Enqueue.Pos.load(std::memory_order_relaxed);
+        size_t count;
+        for (;;)
+        {
+            // A slot whose sequence equals its position can only be taken by whoever moves the cursor past it.
+            count = 0;
+            size_t limit = std::min(items.size(), Capacity());
+            while (count < limit && m_Slots[(pos + count) & m_Mask].Sequence.load(std::memory_order_acquire) == pos + count)
+            {
+                ++count;
+            }
+            if (count == 0)
+            {
+                size_t seq = m_Slots[pos & m_Mask].Sequence.load(std::memory_order_acquire);
+                if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos) < 0)
+                {
+                    return 0;   // full
+                }
+                pos = m_Enqueue.Pos.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (m_Enqueue.Pos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            Slot& slot = m_Slots[(pos + i) & m_Mask];
+            ::new (static_cast<void*>(slot.Storage)) T(items[i]);
+            slot.Sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        Signal(m_PushWait, static_cast<uint32_t>(count));
+        return count;
+    }
+
+    /// <summary>
+    /// Blocking push, sleeps through atomic wait while the queue is full.
+    /// </summary>
+    void Push(T value)
+    {
+        // TryPush only consumes value when it succeeds.
+        if (!TryPush(std::move(value)))
+        {
+            Wait(m_PopWait, [&] { return TryPush(std::move(value)); });
+        }
+    }
+
+    // -------------------------------------------------------------
+    // Consumer
+    // -------------------------------------------------------------
+
+    bool TryPop(Ref<T> out)
+    {
+        return TryConsume([&](T&& value) { out = std::move(value); });
+    }
+
+    /// <summary>
+    /// Claim a run of filled slots with one CAS and move them into out. Returns the count popped.
+    /// </summary>
+    size_t PopN(std::span<T> out)
+    {
+        if (out.empty())
+        {
+            return 0;
+        }
+        size_t pos = m_Dequeue.Pos.load(std::memory_order_relaxed);
+        size_t count;
+        for (;;)
+        {
+            count = 0;
+            size_t limit = std::min(out.size(), Capacity());
+            while (count < limit && m_Slots[(pos + count) & m_Mask].Sequence.load(std::memory_order_acquire) == pos + count + 1)
+            {
+                ++count;
+            }
+            if (count == 0)
+            {
+                size_t seq = m_Slots[pos & m_Mask].Sequence.load(std::memory_order_acquire);
+                if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0)
+                {
+                    return 0;   // empty
+                }
+                pos = m_Dequeue.Pos.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (m_Dequeue.Pos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            Slot& slot = m_Slots[(pos + i) & m_Mask];
+            T* value = slot.Get();
+            out[i] = std::move(*value);
+            std::destroy_at(value);
+            slot.Sequence.store(pos + i + m_Mask + 1, std::memory_order_release);
+        }
+        Signal(m_PopWait, static_cast<uint32_t>(count));
+        return count;
+    }
+
+    /// <summary>
+    /// Blocking pop, sleeps through atomic wait while the queue is empty.
+    /// </summary>
+    T Pop()
+    {
+        // Moved straight out of the slot, T needs no default constructor.
+        std::optional<T> value;
+        auto tryPop = [&] { return TryConsume([&](T&& item) { value.emplace(std::move(item)); }); };
+        if (!tryPop())
+        {
+            Wait(m_PushWait, tryPop);
+        }
+        return std::move(*value);
+    }
+
+    /// <summary>
+    /// Blocking batch pop, returns once at least one item was moved into out.
+    /// </summary>
+    size_t PopN(std::span<T> out, bool wait)
+    {
+        size_t count = PopN(out);
+        if (count == 0 && wait && !out.empty())
+        {
+            Wait(m_PushWait, [&] { return (count = PopN(out)) != 0; });
+        }
+        return count;
+    }
+
+private:
+    // Claim one filled slot and hand its value to consume, which must not throw.
+    template<typename ConsumeFn>
+    bool TryConsume(ConsumeFn&& consume)
+    {
+        size_t pos = m_Dequeue.Pos.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;)
+        {
+            slot = &m_Slots[pos & m_Mask];
+            size_t seq = slot->Sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (m_Dequeue.Pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            } else if (diff < 0)
+            {
+                return false;   // empty
+            } else
+            {
+                pos = m_Dequeue.Pos.load(std::memory_order_relaxed);
+            }
+        }
+        T* value = slot->Get();
+        consume(std::move(*value));
+        std::destroy_at(value);
+        slot->Sequence.store(pos + m_Mask + 1, std::memory_order_release);
+        Signal(m_PopWait, 1);
+        return true;
+    }
+
+    static void Signal(WaitState& state, uint32_t count) noexcept
+    {
+        // Pairs with the ProcessMemoryBarrier in Wait: either we see the waiter or it sees our item on its retry.
+        // The full barrier is paid there, by the thread about to sleep, not here on every push and pop.
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        if (state.Waiters.load(std::memory_order_relaxed) != 0)
+        {
+            state.Event.fetch_add(1, std::memory_order_release);
+            if (count == 1)
+            {
+                state.Event.notify_one();
+            } else
+            {
+                state.Event.notify_all();
+            }
+        }
+    }
+
+    template<typename TryFn>
+    static void Wait(WaitState& state, TryFn&& tryFn)
+    {
+        for (int i = 0; i < s_SpinCount; ++i)
+        {
+            Platform::CpuPause();
+            if (tryFn())
+            {
+                return;
+            }
+        }
+        for (;;)
+        {
+            uint32_t event = state.Event.load(std::memory_order_acquire);
+            state.Waiters.fetch_add(1, std::memory_order_seq_cst);
+            Platform::ProcessMemoryBarrier();
+            if (tryFn())
+            {
+                state.Waiters.fetch_sub(1, std::memory_order_relaxed);
+                return;
+            }
+            state.Event.wait(event, std::memory_order_acquire);
+            state.Waiters.fetch_sub(1, std::memory_order_relaxed);
+            if (tryFn())
+            {
+                return;
+            }
+        }
+    }
+};
+}
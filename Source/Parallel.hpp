@@ -0,0 +1,433 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <exception>
+#include <functional>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+#include "ThreadPool.hpp"
+
+namespace Snowy
+{
+struct ParallelDesc
+{
+    // nullptr uses GlobalThreadPool.
+    ThreadPool* Pool = nullptr;
+    // Ranges up to this many items run serially on the calling thread.
+    size_t SerialThreshold = 4096;
+    // Items processed between split checks, 0 derives it from the range size and worker count.
+    size_t Grain = 0;
+};
+
+namespace Detail
+{
+/// <summary>
+/// Lazy binary splitting over [begin, end). The range is first cut into one piece per worker, then a worker only splits
+/// off half of what it has left when its own deque is empty, i.e. when an idle thread has stolen its last split.
+/// Body is called as body(begin, end, slot) on sub-ranges, slot identifies the job so reductions can keep per-job state.
+/// </summary>
+template<typename Body>
+class TParallelRange
+{
+private:
+    struct Job : ThreadJob
+    {
+        TParallelRange* Owner = nullptr;
+        size_t Begin = 0;
+        size_t End = 0;
+        size_t Slot = 0;
+
+        void Execute() noexcept override
+        {
+            Owner->Process(Begin, End, Slot);
+            Owner->Finish();
+        }
+    };
+
+    ThreadPool& m_Pool;
+    Body& m_Body;
+    size_t m_Grain;
+    std::vector<Job> m_Jobs;    // one up front allocation, splitting stops when they run out
+    std::atomic<size_t> m_NextJob{ 0 };
+    std::exception_ptr m_Exception;
+    std::atomic<bool> m_Failed{ false };
+    alignas(g_CacheLineSize) std::atomic<size_t> m_Pending{ 0 };
+    // Finishers between their m_Pending decrement and their last touch of the range, Wait() waits them out.
+    std::atomic<size_t> m_Exiting{ 0 };
+
+public:
+    // Slot 0 is the calling thread, jobs use 1..maxJobs.
+    TParallelRange(ThreadPool& pool, Body& body, size_t grain, size_t maxJobs)
+        : m_Pool(pool), m_Body(body), m_Grain(grain), m_Jobs(maxJobs)
+    {
+        for (size_t i = 0; i < m_Jobs.size(); ++i)
+        {
+            m_Jobs[i].Owner = this;
+            m_Jobs[i].Slot = i + 1;
+        }
+    }
+
+    void Execute(size_t begin, size_t end, size_t pieces)
+    {
+        m_Pending.store(1, std::memory_order_relaxed);
+        size_t step = (end - begin) / pieces;
+        size_t first = begin + step;
+        for (size_t p = 1; p < pieces; ++p)
+        {
+            size_t pieceBegin = begin + step * p;
+            Spawn(pieceBegin, p + 1 == pieces ? end : pieceBegin + step);
+        }
+        Process(begin, first, 0);
+        Finish();
+        Wait();
+        if (m_Exception)
+        {
+            std::rethrow_exception(m_Exception);
+        }
+    }
+
+private:
+    bool Spawn(size_t begin, size_t end)
+    {
+        size_t index = m_NextJob.fetch_add(1, std::memory_order_relaxed);
+        if (index >= m_Jobs.size())
+        {
+            return false;
+        }
+        Job& job = m_Jobs[index];
+        job.Begin = begin;
+        job.End = end;
+        m_Pending.fetch_add(1, std::memory_order_relaxed);
+        m_Pool.Schedule(&job);
+        return true;
+    }
+
+    void Process(size_t begin, size_t end, size_t slot) noexcept
+    {
+        while (begin < end && !m_Failed.load(std::memory_order_relaxed))
+        {
+            if (end - begin > 2 * m_Grain && m_Pool.IsLocalQueueEmpty())
+            {
+                size_t middle = begin + (end - begin) / 2;
+                if (Spawn(middle, end))
+                {
+                    end = middle;
+                }
+            }
+            size_t chunkEnd = begin + std::min(m_Grain, end - begin);
+            try
+            {
+                m_Body(begin, chunkEnd, slot);
+            } catch (...)
+            {
+                if (!m_Failed.exchange(true, std::memory_order_acq_rel))
+                {
+                    m_Exception = std::current_exception();
+                }
+            }
+            begin = chunkEnd;
+        }
+    }
+
+    void Finish() noexcept
+    {
+        // The range lives on the caller's stack and goes away once Wait() returns, leaving m_Exiting is the last access.
+        m_Exiting.fetch_add(1, std::memory_order_relaxed);
+        if (m_Pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            m_Pending.notify_all();
+        }
+        m_Exiting.fetch_sub(1, std::memory_order_release);
+    }
+
+    void Wait()
+    {
+        if (m_Pool.CurrentWorkerIndex() >= 0)
+        {
+            while (m_Pending.load(std::memory_order_acquire) != 0 && m_Pool.TryRunOne())
+            {
+            }
+        }
+        for (size_t pending = m_Pending.load(std::memory_order_acquire); pending != 0;
+             pending = m_Pending.load(std::memory_order_acquire))
+        {
+            m_Pending.wait(pending, std::memory_order_acquire);
+        }
+        while (m_Exiting.load(std::memory_order_acquire) != 0)
+        {
+            Platform::CpuPause();
+        }
+    }
+};
+
+inline ThreadPool& ParallelPool(In<ParallelDesc> desc)
+{
+    return desc.Pool != nullptr ? *desc.Pool : GlobalThreadPool::GetInstance();
+}
+
+struct ParallelPlan
+{
+    bool Serial = true;
+    size_t Grain = 0;
+    size_t Pieces = 1;      // initial split, one per worker plus the caller
+    size_t MaxJobs = 0;
+
+    // Distinct slot values body may see.
+    size_t SlotCount() const noexcept { return Serial ? 1 : MaxJobs + 1; }
+};
+
+inline ParallelPlan MakeParallelPlan(size_t count, In<ParallelDesc> desc)
+{
+    ParallelPlan plan;
+    if (count <= desc.SerialThreshold)
+    {
+        return plan;
+    }
+    size_t workers = ParallelPool(desc).WorkerCount();
+    plan.Serial = false;
+    plan.Grain = desc.Grain != 0 ? desc.Grain : std::clamp<size_t>(count / (workers * 16), 1, 2048);
+    plan.Pieces = std::clamp<size_t>(count / plan.Grain, 1, workers + 1);
+    plan.MaxJobs = std::max(std::min(count / plan.Grain, workers * 64), plan.Pieces);
+    return plan;
+}
+
+template<typename Body>
+void ParallelRun(size_t begin, size_t end, Body& body, In<ParallelDesc> desc, In<ParallelPlan> plan)
+{
+    if (plan.Serial)
+    {
+        if (end > begin)
+        {
+            body(begin, end, size_t(0));
+        }
+        return;
+    }
+    TParallelRange<Body> range(ParallelPool(desc), body, plan.Grain, plan.MaxJobs);
+    range.Execute(begin, end, plan.Pieces);
+}
+template<typename Body>
+void ParallelRun(size_t begin, size_t end, Body& body, In<ParallelDesc> desc)
+{
+    ParallelRun(begin, end, body, desc, MakeParallelPlan(end > begin ? end - begin : 0, desc));
+}
+
+template<typename T>
+struct alignas(g_CacheLineSize) TPaddedValue
+{
+    T Value;
+};
+}
+
+// -------------------------------------------------------------
+// ParallelFor
+// -------------------------------------------------------------
+
+/// <summary>
+/// fn(i) for every i in [begin, end), spread over the pool. Rethrows the first exception after the other chunks stopped.
+/// </summary>
+template<typename Fn>
+void ParallelFor(size_t begin, size_t end, Fn&& fn, In<ParallelDesc> desc = {})
+{
+    auto body = [&](size_t first, size_t last, size_t) {
+        for (size_t i = first; i < last; ++i)
+        {
+            fn(i);
+        }
+    };
+    Detail::ParallelRun(begin, end, body, desc);
+}
+
+/// <summary>
+/// fn(first, last) on contiguous sub-ranges, for bodies that want to vectorize or hoist work out of the inner loop.
+/// </summary>
+template<typename Fn>
+void ParallelForRange(size_t begin, size_t end, Fn&& fn, In<ParallelDesc> desc = {})
+{
+    auto body = [&](size_t first, size_t last, size_t) { fn(first, last); };
+    Detail::ParallelRun(begin, end, body, desc);
+}
+
+/// <summary>
+/// fn(element) for every element.
+/// </summary>
+template<typename T, typename Fn>
+void ParallelFor(std::span<T> data, Fn&& fn, In<ParallelDesc> desc = {})
+{
+    ParallelFor(size_t(0), data.size(), [&](size_t i) { fn(data[i]); }, desc);
+}
+template<typename T, typename Fn>
+void ParallelFor(ArrayIn<T> data, Fn&& fn, In<ParallelDesc> desc = {})
+{
+    ParallelFor(size_t(0), data.size(), [&](size_t i) { fn(data[i]); }, desc);
+}
+
+// -------------------------------------------------------------
+// ParallelTransform
+// -------------------------------------------------------------
+
+/// <summary>
+/// output[i] = fn(input[i]). output must be at least as large as input.
+/// </summary>
+template<typename T, typename U, typename Fn>
+void ParallelTransform(ArrayIn<T> input, std::span<U> output, Fn&& fn, In<ParallelDesc> desc = {})
+{
+    SAssert(output.size() >= input.size());
+    ParallelForRange(size_t(0), input.size(), [&](size_t first, size_t last) {
+        std::transform(input.begin() + first, input.begin() + last, output.begin() + first, fn);
+    }, desc);
+}
+
+// -------------------------------------------------------------
+// ParallelReduce
+// -------------------------------------------------------------
+
+/// <summary>
+/// Reduce map(i) for i in [begin, end) with reduce, starting every partial from identity.
+/// reduce must be associative and commutative, partials are combined in no particular order.
+/// </summary>
+template<typename T, typename Map, typename Reduce>
+T ParallelReduce(size_t begin, size_t end, T identity, Map&& map, Reduce&& reduce, In<ParallelDesc> desc = {})
+{
+    Detail::ParallelPlan plan = Detail::MakeParallelPlan(end > begin ? end - begin : 0, desc);
+    std::vector<Detail::TPaddedValue<T>> partials(plan.SlotCount(), Detail::TPaddedValue<T>{ identity });
+    auto body = [&](size_t first, size_t last, size_t slot) {
+        T acc = std::move(partials[slot].Value);
+        for (size_t i = first; i < last; ++i)
+        {
+            acc = reduce(std::move(acc), map(i));
+        }
+        partials[slot].Value = std::move(acc);
+    };
+    Detail::ParallelRun(begin, end, body, desc, plan);
+    T result = std::move(identity);
+    for (auto& partial : partials)
+    {
+        result = reduce(std::move(result), std::move(partial.Value));
+    }
+    return result;
+}
+
+/// <summary>
+/// Reduce the elements of data, e.g. ParallelReduce(values, 0.0, std::plus<>()).
+/// </summary>
+template<typename T, typename U, typename Reduce>
+U ParallelReduce(ArrayIn<T> data, U identity, Reduce&& reduce, In<ParallelDesc> desc = {})
+{
+    return ParallelReduce(size_t(0), data.size(), std::move(identity),
+                          [&](size_t i) -> const T& { return data[i]; }, reduce, desc);
+}
+
+// -------------------------------------------------------------
+// ParallelSort
+// -------------------------------------------------------------
+
+namespace Detail
+{
+// Number of elements of a among the first k elements of merge(a, b), found by binary search. Ties take a first,
+// like std::merge, so splitting the output at any k and merging the pieces separately gives the same result.
+template<typename T, typename Compare>
+size_t MergeCoRank(const T* a, size_t aSize, const T* b, size_t bSize, size_t k, Compare& less)
+{
+    size_t low = k > bSize ? k - bSize : 0;
+    size_t high = std::min(k, aSize);
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (!less(b[k - middle - 1], a[middle]))
+        {
+            low = middle + 1;
+        } else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+}
+
+/// <summary>
+/// Sort the runs of a power of two split in parallel, then merge neighbouring runs pairwise. Every round splits its merges
+/// by co-rank into as many pieces as there are runs, so the last round is as parallel as the first. Rounds ping-pong
+/// between data and one scratch buffer of default constructed T. Not stable.
+/// </summary>
+template<typename T, typename Compare = std::less<>>
+void ParallelSort(std::span<T> data, Compare less = {}, In<ParallelDesc> desc = {})
+{
+    size_t count = data.size();
+    if (count <= desc.SerialThreshold)
+    {
+        std::sort(data.begin(), data.end(), less);
+        return;
+    }
+    ThreadPool& pool = Detail::ParallelPool(desc);
+    // A few runs per worker so stealing can even out uneven partitions.
+    size_t runs = std::bit_ceil(size_t(pool.WorkerCount()) * 4);
+    runs = std::min(runs, std::bit_floor(std::max<size_t>(count / std::max<size_t>(desc.SerialThreshold, 1), 1)));
+    if (runs == 1)
+    {
+        std::sort(data.begin(), data.end(), less);
+        return;
+    }
+    auto boundary = [&](size_t run) { return count * run / runs; };
+
+    ParallelDesc jobDesc = desc;
+    jobDesc.SerialThreshold = 1;
+    jobDesc.Grain = 1;
+
+    // Sort where an even number of merge rounds away from data, so the last round writes into data.
+    UniqueHandle<T[]> scratch = std::make_unique_for_overwrite<T[]>(count);
+    T* source = std::countr_zero(runs) % 2 == 0 ? data.data() : scratch.get();
+    T* target = source == data.data() ? scratch.get() : data.data();
+    ParallelFor(size_t(0), runs, [&](size_t run) {
+        T* first = source + boundary(run);
+        T* last = source + boundary(run + 1);
+        if (source != data.data())
+        {
+            std::move(data.data() + boundary(run), data.data() + boundary(run + 1), first);
+        }
+        std::sort(first, last, less);
+    }, jobDesc);
+
+    // Each round cuts every pair's merge into width * 2 pieces; splits[piece] is how many elements of the first run
+    // precede the piece. All splits are found before any piece moves elements out of source.
+    std::vector<size_t> splits(runs);
+    for (size_t width = 1; width < runs; width *= 2)
+    {
+        size_t piecesPerPair = width * 2;
+        auto pairRange = [&](size_t piece, size_t& lo, size_t& mid, size_t& hi) {
+            size_t firstRun = piece / piecesPerPair * piecesPerPair;
+            lo = boundary(firstRun);
+            mid = boundary(firstRun + width);
+            hi = boundary(firstRun + piecesPerPair);
+        };
+        auto outputStart = [&](size_t piece, size_t length) { return length * (piece % piecesPerPair) / piecesPerPair; };
+        ParallelFor(size_t(0), runs, [&](size_t piece) {
+            size_t lo, mid, hi;
+            pairRange(piece, lo, mid, hi);
+            splits[piece] =
+                Detail::MergeCoRank<T>(source + lo, mid - lo, source + mid, hi - mid, outputStart(piece, hi - lo), less);
+        }, jobDesc);
+        ParallelFor(size_t(0), runs, [&](size_t piece) {
+            size_t lo, mid, hi;
+            pairRange(piece, lo, mid, hi);
+            bool last = piece % piecesPerPair == piecesPerPair - 1;
+            size_t kBegin = outputStart(piece, hi - lo);
+            size_t kEnd = last ? hi - lo : outputStart(piece + 1, hi - lo);
+            size_t aBegin = splits[piece];
+            size_t aEnd = last ? mid - lo : splits[piece + 1];
+            T* a = source + lo;
+            T* b = source + mid;
+            std::merge(std::make_move_iterator(a + aBegin), std::make_move_iterator(a + aEnd),
+                       std::make_move_iterator(b + (kBegin - aBegin)), std::make_move_iterator(b + (kEnd - aEnd)),
+                       target + lo + kBegin, less);
+        }, jobDesc);
+        std::swap(source, target);
+    }
+    SAssert(source == data.data());
+}
+}
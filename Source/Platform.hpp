@@ -1,7 +1,15 @@
 ﻿#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string_view>
+#include <utility>
 
 #if defined(_WIN32)
 #include <Windows.h>
+#include <intrin.h>
 #define SNOWY_CXX_VERSION _MSVC_LANG
 #else
 #error "Platform is not support!"
@@ -13,6 +21,67 @@ namespace Snowy
 class Platform
 {
 public:
+    // Hint to the cpu that we are in a spin-wait loop.
+    static void CpuPause() noexcept
+    {
+    #if defined(_WIN32)
+        YieldProcessor();
+    #else
+        #error "Platform is not support!"
+    #endif 
+    }
+    // Raw time stamp counter, constant rate on current cpus. Ticks are not nanoseconds, calibrate against a clock.
+    static uint64_t CycleCounter() noexcept
+    {
+    #if defined(_WIN32)
+        return __rdtsc();
+    #else
+        #error "Platform is not support!"
+    #endif 
+    }
+    // Cycles the cpu spent executing the calling thread, unlike CycleCounter it doesn't advance while descheduled.
+    static uint64_t ThreadCycleCounter() noexcept
+    {
+    #if defined(_WIN32)
+        ULONG64 cycles = 0;
+        QueryThreadCycleTime(GetCurrentThread(), &cycles);
+        return cycles;
+    #else
+        #error "Platform is not support!"
+    #endif 
+    }
+    // Restrict the calling thread to a single logical core, returns false on failure.
+    // Only cores of the thread's current processor group can be addressed, core must be below the mask width (64, or 32 on x86).
+    static bool PinCurrentThread(const unsigned core)
+    {
+    #if defined(_WIN32)
+        if (core >= sizeof(DWORD_PTR) * 8)
+        {
+            return false;
+        }
+        return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core) != 0;
+    #else
+        #error "Platform is not support!"
+    #endif 
+    }
+    // Index of the logical core the calling thread is running on right now, may change at any time.
+    static unsigned CurrentProcessor() noexcept
+    {
+    #if defined(_WIN32)
+        return GetCurrentProcessorNumber();
+    #else
+        #error "Platform is not support!"
+    #endif 
+    }
+    // Make every thread of the process execute a full memory barrier, lets hot paths get away with compiler-only fences.
+    static void ProcessMemoryBarrier() noexcept
+    {
+    #if defined(_WIN32)
+        FlushProcessWriteBuffers();
+    #else
+        #error "Platform is not support!"
+    #endif 
+    }
     static char* WideStringToAnsi(const wchar_t* wStr, const int wSize)
     {
     #if defined(_WIN32)
@@ -56,4 +125,271 @@ public:
     #endif 
     }
 };
+
+enum class MappedFileAccess : uint8_t
+{
+    Read,
+    ReadWrite,  // opens or creates the file, writes go straight to the page cache
+};
+
+enum class MappedFileAdvice : uint8_t
+{
+    Normal,
+    Sequential,     // read-ahead aggressively, drop pages behind
+    Random,         // no read-ahead
+    WillNeed,       // start reading the range in now
+};
+
+struct MappedFileDesc
+{
+    MappedFileAccess Access = MappedFileAccess::Read;
+    // Access pattern for the whole file, fixed at open on Windows.
+    MappedFileAdvice Advice = MappedFileAdvice::Normal;
+    // Fault every page in during Open, like MAP_POPULATE, so the first pass doesn't page fault.
+    bool Populate = false;
+    // Ask for large pages. Windows only backs pagefile sections with them, file mappings ignore the hint there.
+    bool LargePages = false;
+    // ReadWrite only: grow the file to at least this many bytes.
+    uint64_t MinSize = 0;
+};
+
+/// <summary>
+/// Memory mapped file. Loaders get the bytes as a view instead of reading them into a string,
+/// so the page cache is the only copy and nothing is read until it is touched.
+/// </summary>
+class MappedFile
+{
+private:
+#if defined(_WIN32)
+    HANDLE m_File = INVALID_HANDLE_VALUE;
+    HANDLE m_Mapping = nullptr;
+#endif
+    std::byte* m_Data = nullptr;
+    uint64_t m_Size = 0;
+    MappedFileDesc m_Desc;
+
+public:
+    MappedFile() = default;
+    MappedFile(const std::filesystem::path& path, const MappedFileDesc& desc = {}) { Open(path, desc); }
+    ~MappedFile() { Close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept { Swap(other); }
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Close();
+            Swap(other);
+        }
+        return *this;
+    }
+
+    bool Open(const std::filesystem::path& path, const MappedFileDesc& desc = {})
+    {
+    #if defined(_WIN32)
+        Close();
+        m_Desc = desc;
+        bool write = desc.Access == MappedFileAccess::ReadWrite;
+        DWORD flags = FILE_ATTRIBUTE_NORMAL;
+        if (desc.Advice == MappedFileAdvice::Sequential)
+        {
+            flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+        } else if (desc.Advice == MappedFileAdvice::Random)
+        {
+            flags |= FILE_FLAG_RANDOM_ACCESS;
+        }
+        m_File = CreateFileW(path.c_str(), write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                             nullptr, write ? OPEN_ALWAYS : OPEN_EXISTING, flags, nullptr);
+        if (m_File == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        LARGE_INTEGER size{};
+        if (!GetFileSizeEx(m_File, &size))
+        {
+            Close();
+            return false;
+        }
+        uint64_t target = write ? std::max<uint64_t>(uint64_t(size.QuadPart), desc.MinSize) : uint64_t(size.QuadPart);
+        if (!Map(target))
+        {
+            Close();
+            return false;
+        }
+        if (desc.Populate)
+        {
+            Advise(0, m_Size, MappedFileAdvice::WillNeed);
+            // Prefetching only reads ahead, touching each page also maps it.
+            for (uint64_t offset = 0; offset < m_Size; offset += 4096)
+            {
+                static_cast<void>(*static_cast<volatile const std::byte*>(m_Data + offset));
+            }
+        }
+        return true;
+    #else
+        #error "Platform is not support!"
+    #endif 
+    }
+
+    void Close() noexcept
+    {
+    #if defined(_WIN32)
+        Unmap();
+        if (m_File != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_File);
+            m_File = INVALID_HANDLE_VALUE;
+        }
+    #else
+        #error "Platform is not support!"
+    #endif 
+    }
+
+    bool IsOpen() const noexcept
+    {
+    #if defined(_WIN32)
+        return m_File != INVALID_HANDLE_VALUE;
+    #else
+        #error "Platform is not support!"
+    #endif 
+    }
+    bool IsWritable() const noexcept { return IsOpen() && m_Desc.Access == MappedFileAccess::ReadWrite; }
+    uint64_t Size() const noexcept { return m_Size; }
+
+    // ArrayIn<std::byte>
+    std::span<const std::byte> Bytes() const noexcept { return { m_Data, size_t(m_Size) }; }
+    std::span<std::byte> MutableBytes() noexcept
+    {
+        return IsWritable() ? std::span<std::byte>(m_Data, size_t(m_Size)) : std::span<std::byte>();
+    }
+    /// <summary>
+    /// The contents as text, View<SChar>() is an SStringIn. A trailing partial character is cut off.
+    /// </summary>
+    template<typename CharT = char>
+    std::basic_string_view<CharT> View() const noexcept
+    {
+        return { reinterpret_cast<const CharT*>(m_Data), size_t(m_Size / sizeof(CharT)) };
+    }
+
+    /// <summary>
+    /// Hint the access pattern of [offset, offset + size). Only WillNeed applies after Open on Windows, it starts
+    /// reading the range into the page cache asynchronously.
+    /// </summary>
+    void Advise(uint64_t offset, uint64_t size, MappedFileAdvice advice) noexcept
+    {
+    #if defined(_WIN32)
+        if (advice != MappedFileAdvice::WillNeed || offset >= m_Size)
+        {
+            return;
+        }
+        WIN32_MEMORY_RANGE_ENTRY range{ m_Data + offset, size_t(std::min(size, m_Size - offset)) };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    #else
+        #error "Platform is not support!"
+    #endif 
+    }
+
+    /// <summary>
+    /// Grow or shrink a writable file and remap it. Views taken before are invalidated,
+    /// grow geometrically when appending to keep the remaps rare.
+    /// </summary>
+    bool Resize(uint64_t size)
+    {
+    #if defined(_WIN32)
+        if (!IsWritable())
+        {
+            return false;
+        }
+        Unmap();
+        return Map(size);
+    #else
+        #error "Platform is not support!"
+    #endif 
+    }
+
+    /// <summary>
+    /// Write dirty pages back and wait for the file to reach the disk.
+    /// </summary>
+    bool Flush() noexcept
+    {
+    #if defined(_WIN32)
+        if (!IsWritable())
+        {
+            return false;
+        }
+        return (m_Data == nullptr || FlushViewOfFile(m_Data, 0)) && FlushFileBuffers(m_File);
+    #else
+        #error "Platform is not support!"
+    #endif 
+    }
+
+    void Swap(MappedFile& other) noexcept
+    {
+    #if defined(_WIN32)
+        std::swap(m_File, other.m_File);
+        std::swap(m_Mapping, other.m_Mapping);
+    #endif
+        std::swap(m_Data, other.m_Data);
+        std::swap(m_Size, other.m_Size);
+        std::swap(m_Desc, other.m_Desc);
+    }
+
+private:
+    bool Map(uint64_t size)
+    {
+    #if defined(_WIN32)
+        bool write = m_Desc.Access == MappedFileAccess::ReadWrite;
+        if (write)
+        {
+            LARGE_INTEGER end{};
+            end.QuadPart = LONGLONG(size);
+            if (!SetFilePointerEx(m_File, end, nullptr, FILE_BEGIN) || !SetEndOfFile(m_File))
+            {
+                return false;
+            }
+        }
+        m_Size = size;
+        // Empty files can't be mapped, they are an empty view.
+        if (size == 0)
+        {
+            return true;
+        }
+        m_Mapping = CreateFileMappingW(m_File, nullptr, write ? PAGE_READWRITE : PAGE_READONLY, DWORD(size >> 32), DWORD(size), nullptr);
+        if (m_Mapping == nullptr)
+        {
+            m_Size = 0;
+            return false;
+        }
+        m_Data = static_cast<std::byte*>(MapViewOfFile(m_Mapping, write ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0));
+        if (m_Data == nullptr)
+        {
+            Unmap();
+            return false;
+        }
+        return true;
+    #else
+        #error "Platform is not support!"
+    #endif 
+    }
+
+    void Unmap() noexcept
+    {
+    #if defined(_WIN32)
+        if (m_Data != nullptr)
+        {
+            UnmapViewOfFile(m_Data);
+            m_Data = nullptr;
+        }
+        if (m_Mapping != nullptr)
+        {
+            CloseHandle(m_Mapping);
+            m_Mapping = nullptr;
+        }
+        m_Size = 0;
+    #else
+        #error "Platform is not support!"
+    #endif 
+    }
+};
 }
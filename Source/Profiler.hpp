@@ -0,0 +1,401 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+#include "String.hpp"
+#include "Singleton.hpp"
+
+namespace Snowy
+{
+struct ProfilerDesc
+{
+    // Zones each thread can buffer between drains, zones beyond that are dropped and counted.
+    // Applies to threads that record their first zone after the capture started.
+    size_t ThreadBufferCapacity = size_t(1) << 14;
+    // How often the background thread moves the buffers to the file.
+    std::chrono::milliseconds DrainInterval = std::chrono::milliseconds(10);
+};
+
+struct ProfileEvent
+{
+    const char* Name = nullptr;     // static zone name
+    uint64_t Begin = 0;             // Platform::CycleCounter ticks
+    uint64_t End = 0;
+};
+
+/// <summary>
+/// Collects SProfileScope zones into per-thread lock-free buffers and streams them to a Chrome Trace Event JSON file,
+/// which chrome://tracing and ui.perfetto.dev open directly. Zones cost nothing but a flag load while not capturing.
+/// Stop the threads that record zones before SingletonRegistry::Shutdown, a zone recorded after it is dropped.
+/// </summary>
+class Profiler : public TSingleton<Profiler>
+{
+    friend class TSingleton<Profiler>;
+
+private:
+    // Single producer ring like TSpscQueue minus its wakeup handshake: the drain thread polls, so a push is a slot
+    // write and a release store, no fence.
+    struct ThreadBuffer
+    {
+        UniqueHandle<ProfileEvent[]> Events;
+        size_t Mask;
+        uint32_t ThreadId;
+        alignas(g_CacheLineSize) std::atomic<size_t> Head{ 0 };
+        size_t CachedTail = 0;
+        std::atomic<uint64_t> Dropped{ 0 };
+        std::atomic<bool> Exited{ false };
+        alignas(g_CacheLineSize) std::atomic<size_t> Tail{ 0 };
+        // Guarded by m_Mutex.
+        std::string Name;
+        bool NameWritten = false;
+
+        ThreadBuffer(size_t capacity, uint32_t threadId)
+            : Events(MakeUnique<ProfileEvent[]>(std::bit_ceil(std::max<size_t>(capacity, 2))))
+            , Mask(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1)
+            , ThreadId(threadId)
+        {}
+
+        void Push(In<ProfileEvent> event) noexcept
+        {
+            size_t head = Head.load(std::memory_order_relaxed);
+            if (head - CachedTail > Mask)
+            {
+                CachedTail = Tail.load(std::memory_order_acquire);
+                if (head - CachedTail > Mask)
+                {
+                    Dropped.store(Dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    return;
+                }
+            }
+            Events[head & Mask] = event;
+            Head.store(head + 1, std::memory_order_release);
+        }
+        size_t PopN(std::span<ProfileEvent> out) noexcept
+        {
+            size_t tail = Tail.load(std::memory_order_relaxed);
+            size_t count = std::min(out.size(), Head.load(std::memory_order_acquire) - tail);
+            for (size_t i = 0; i < count; ++i)
+            {
+                out[i] = Events[(tail + i) & Mask];
+            }
+            Tail.store(tail + count, std::memory_order_release);
+            return count;
+        }
+    };
+
+    struct ThreadExit
+    {
+        ~ThreadExit()
+        {
+            if (s_Buffer != nullptr && s_BufferEpoch == s_Epoch.load(std::memory_order_acquire))
+            {
+                s_Buffer->Exited.store(true, std::memory_order_release);
+            }
+            s_Buffer = nullptr;
+        }
+    };
+
+    static constexpr size_t s_DrainBatch = 1024;
+
+    static inline std::atomic<bool> s_Capturing{ false };
+    // Bumped when a Profiler goes away, a thread's s_Buffer from an earlier epoch belongs to a destroyed instance.
+    static inline std::atomic<uint32_t> s_Epoch{ 0 };
+    static inline thread_local ThreadBuffer* s_Buffer = nullptr;
+    static inline thread_local uint32_t s_BufferEpoch = 0;
+
+    std::mutex m_Mutex;
+    std::vector<UniqueHandle<ThreadBuffer>> m_Buffers;
+    uint32_t m_NextThreadId = 1;
+    uint64_t m_ExitedDropped = 0;   // drops of buffers already released
+    ProfilerDesc m_Desc;
+    std::ofstream m_File;
+    bool m_FirstEvent = true;
+    uint64_t m_TickBase = 0;
+    double m_NanosecondsPerTick = 1.0;
+    std::vector<ProfileEvent> m_Scratch;
+
+    std::thread m_DrainThread;
+    std::condition_variable m_DrainWake;
+    bool m_StopDrain = false;
+
+protected:
+    Profiler() = default;
+    ~Profiler()
+    {
+        s_Epoch.fetch_add(1, std::memory_order_acq_rel);
+        StopCapture();
+    }
+
+public:
+    static bool IsCapturing() noexcept { return s_Capturing.load(std::memory_order_relaxed); }
+
+    /// <summary>
+    /// Start writing zones to file, returns false if a capture is already running or the file can't be created.
+    /// </summary>
+    bool StartCapture(const std::filesystem::path& file, In<ProfilerDesc> desc = {})
+    {
+        std::unique_lock lock(m_Mutex);
+        if (m_File.is_open())
+        {
+            return false;
+        }
+        m_File.open(file, std::ios::out | std::ios::trunc);
+        if (!m_File)
+        {
+            m_File = std::ofstream();
+            return false;
+        }
+        m_Desc = desc;
+        m_File << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        m_FirstEvent = true;
+        m_Scratch.resize(s_DrainBatch);
+        m_ExitedDropped = 0;
+        // Zones left over from an earlier capture would land before the tick base.
+        for (auto& buffer : m_Buffers)
+        {
+            while (buffer->PopN(m_Scratch) != 0)
+            {
+            }
+            buffer->Dropped.store(0, std::memory_order_relaxed);
+            buffer->NameWritten = false;
+        }
+        lock.unlock();
+
+        Calibrate();
+
+        lock.lock();
+        m_StopDrain = false;
+        m_DrainThread = std::thread([this] { DrainLoop(); });
+        s_Capturing.store(true, std::memory_order_relaxed);
+        return true;
+    }
+
+    /// <summary>
+    /// Stop capturing, drain what is left and close the file.
+    /// </summary>
+    void StopCapture()
+    {
+        s_Capturing.store(false, std::memory_order_relaxed);
+        {
+            std::lock_guard lock(m_Mutex);
+            m_StopDrain = true;
+        }
+        m_DrainWake.notify_one();
+        if (m_DrainThread.joinable())
+        {
+            m_DrainThread.join();
+        }
+        std::lock_guard lock(m_Mutex);
+        if (!m_File.is_open())
+        {
+            return;
+        }
+        DrainLocked();
+        m_File << "\n]}\n";
+        m_File.close();
+    }
+
+    /// <summary>
+    /// Name the calling thread in the trace.
+    /// </summary>
+    void SetThreadName(AnsiStringIn name)
+    {
+        ThreadBuffer* buffer = CurrentBuffer();
+        std::lock_guard lock(m_Mutex);
+        buffer->Name = name;
+        buffer->NameWritten = false;
+    }
+
+    /// <summary>
+    /// Zones dropped because a thread buffer was full, since the capture started.
+    /// </summary>
+    uint64_t DroppedCount()
+    {
+        std::lock_guard lock(m_Mutex);
+        uint64_t dropped = m_ExitedDropped;
+        for (auto& buffer : m_Buffers)
+        {
+            dropped += buffer->Dropped.load(std::memory_order_relaxed);
+        }
+        return dropped;
+    }
+
+    static void Record(const char* name, uint64_t begin, uint64_t end)
+    {
+        ThreadBuffer* buffer = s_Buffer;
+        if (buffer == nullptr || s_BufferEpoch != s_Epoch.load(std::memory_order_relaxed)) [[unlikely]]
+        {
+            buffer = AttachBuffer();
+            if (buffer == nullptr)
+            {
+                return;
+            }
+        }
+        buffer->Push(ProfileEvent{ name, begin, end });
+    }
+
+private:
+    // Cold path of Record. The first zone ever constructs the Profiler, but one recorded after Shutdown must not bring
+    // it back.
+    static ThreadBuffer* AttachBuffer()
+    {
+        if (!IsInitialized() && s_Epoch.load(std::memory_order_acquire) != 0)
+        {
+            SAssert(!"Zone recorded after SingletonRegistry::Shutdown, stop profiled threads first.");
+            return nullptr;
+        }
+        return GetInstance().CurrentBuffer();
+    }
+
+    ThreadBuffer* CurrentBuffer()
+    {
+        uint32_t epoch = s_Epoch.load(std::memory_order_acquire);
+        if (s_Buffer == nullptr || s_BufferEpoch != epoch)
+        {
+            static thread_local ThreadExit s_ThreadExit;
+            (void)s_ThreadExit;
+            std::lock_guard lock(m_Mutex);
+            m_Buffers.push_back(MakeUnique<ThreadBuffer>(m_Desc.ThreadBufferCapacity, m_NextThreadId++));
+            s_Buffer = m_Buffers.back().get();
+            s_BufferEpoch = epoch;
+        }
+        return s_Buffer;
+    }
+
+    void Calibrate()
+    {
+        CycleCalibration calibration = CycleCalibration::Measure();
+        std::lock_guard lock(m_Mutex);
+        m_TickBase = calibration.TickBase;
+        m_NanosecondsPerTick = calibration.NanosecondsPerTick;
+    }
+
+    void DrainLoop()
+    {
+        std::unique_lock lock(m_Mutex);
+        while (!m_StopDrain)
+        {
+            m_DrainWake.wait_for(lock, m_Desc.DrainInterval);
+            DrainLocked();
+        }
+    }
+
+    void DrainLocked()
+    {
+        for (auto it = m_Buffers.begin(); it != m_Buffers.end();)
+        {
+            ThreadBuffer& buffer = **it;
+            // Exited is read first, so nothing can be pushed after the drain below empties the buffer.
+            bool exited = buffer.Exited.load(std::memory_order_acquire);
+            if (!buffer.NameWritten && !buffer.Name.empty())
+            {
+                BeginEvent();
+                m_File << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer.ThreadId << ",\"args\":{\"name\":";
+                WriteJsonString(buffer.Name.c_str());
+                m_File << "}}";
+                buffer.NameWritten = true;
+            }
+            for (size_t count = buffer.PopN(m_Scratch); count != 0; count = buffer.PopN(m_Scratch))
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    WriteZone(buffer.ThreadId, m_Scratch[i]);
+                }
+            }
+            if (exited)
+            {
+                m_ExitedDropped += buffer.Dropped.load(std::memory_order_relaxed);
+                it = m_Buffers.erase(it);
+            } else
+            {
+                ++it;
+            }
+        }
+        m_File.flush();
+    }
+
+    void WriteZone(uint32_t threadId, In<ProfileEvent> event)
+    {
+        // Zones of a capture that ended before the tick base are stale.
+        if (event.Begin < m_TickBase)
+        {
+            return;
+        }
+        double begin = double(event.Begin - m_TickBase) * m_NanosecondsPerTick / 1000.0;
+        double duration = double(event.End - event.Begin) * m_NanosecondsPerTick / 1000.0;
+        BeginEvent();
+        m_File << "{\"name\":";
+        WriteJsonString(event.Name);
+        m_File << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << threadId << ",\"ts\":" << begin << ",\"dur\":" << duration << '}';
+    }
+
+    void BeginEvent()
+    {
+        if (!m_FirstEvent)
+        {
+            m_File << ',';
+        }
+        m_File << '\n';
+        m_FirstEvent = false;
+    }
+
+    void WriteJsonString(const char* text)
+    {
+        m_File << '"';
+        for (; *text != '\0'; ++text)
+        {
+            char c = *text;
+            if (c == '"' || c == '\\')
+            {
+                m_File << '\\' << c;
+            } else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                m_File << ' ';
+            } else
+            {
+                m_File << c;
+            }
+        }
+        m_File << '"';
+    }
+};
+
+/// <summary>
+/// Times its own lifetime as a zone named Name, use through SProfileScope.
+/// </summary>
+template<FixedString Name>
+class TProfileScope
+{
+    static_assert(std::is_same_v<typename SDecayOf(Name)::CharType, char>, "Profile zone names are narrow strings.");
+
+private:
+    uint64_t m_Begin;
+
+public:
+    TProfileScope() noexcept : m_Begin(Profiler::IsCapturing() ? Platform::CycleCounter() : 0) {}
+    ~TProfileScope()
+    {
+        if (m_Begin != 0)
+        {
+            Profiler::Record(Name.buffer, m_Begin, Platform::CycleCounter());
+        }
+    }
+    TProfileScope(const TProfileScope&) = delete;
+    TProfileScope& operator=(const TProfileScope&) = delete;
+};
+}
@@ -0,0 +1,617 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+#include "Singleton.hpp"
+#include "Lock.hpp"
+
+namespace Snowy
+{
+// Safe memory reclamation for lock-free readers: a writer unlinks an object and retires it, and the object is only
+// deleted once no reader can still hold it. Readers pay no reference counting, their publish is a relaxed store plus a
+// compiler fence, the reclaiming side pays for the full barrier with Platform::ProcessMemoryBarrier instead.
+
+namespace Detail
+{
+struct RetiredObject
+{
+    void* Object = nullptr;
+    void (*Deleter)(void*) = nullptr;
+    uint64_t Epoch = 0;     // only used by EpochDomain
+};
+
+template<typename T>
+void DeleteRetired(void* object)
+{
+    delete static_cast<T*>(object);
+}
+
+inline void DeleteRetiredObjects(std::vector<RetiredObject>& objects)
+{
+    for (RetiredObject& retired : objects)
+    {
+        retired.Deleter(retired.Object);
+    }
+    objects.clear();
+}
+
+/// <summary>
+/// Append-only lock-free list of per-thread records. A thread claims a free record on first use and hands it back at
+/// thread exit, so thread churn reuses records instead of growing the list.
+/// </summary>
+template<typename Record>
+class TThreadRecordList
+{
+private:
+    std::atomic<Record*> m_Head{ nullptr };
+
+public:
+    TThreadRecordList() = default;
+    TThreadRecordList(const TThreadRecordList&) = delete;
+    TThreadRecordList& operator=(const TThreadRecordList&) = delete;
+    ~TThreadRecordList()
+    {
+        for (Record* record = m_Head.load(std::memory_order_acquire); record != nullptr;)
+        {
+            Record* next = record->Next;
+            delete record;
+            record = next;
+        }
+    }
+
+    Record* Head() const noexcept { return m_Head.load(std::memory_order_acquire); }
+
+    Record* Acquire()
+    {
+        for (Record* record = Head(); record != nullptr; record = record->Next)
+        {
+            bool expected = false;
+            if (!record->InUse.load(std::memory_order_relaxed)
+                && record->InUse.compare_exchange_strong(expected, true, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                return record;
+            }
+        }
+        Record* record = new Record();
+        record->InUse.store(true, std::memory_order_relaxed);
+        Record* head = m_Head.load(std::memory_order_relaxed);
+        do
+        {
+            record->Next = head;
+        } while (!m_Head.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+        return record;
+    }
+
+    void Release(Record* record) noexcept { record->InUse.store(false, std::memory_order_release); }
+};
+}
+
+// -------------------------------------------------------------
+// Epoch Based Reclamation
+// -------------------------------------------------------------
+
+/// <summary>
+/// Process wide epoch domain. Readers pin the current epoch for the length of an EpochGuard, an object retired in
+/// epoch e is deleted once the global epoch reached e + 2, i.e. once every reader pinned before the unlink has left.
+/// Stop the threads using it before SingletonRegistry::Shutdown.
+/// </summary>
+class EpochDomain : public TSingleton<EpochDomain>
+{
+    friend class TSingleton<EpochDomain>;
+
+private:
+    static constexpr uint64_t s_Quiescent = 0;
+    static constexpr size_t s_CollectThreshold = 64;
+    static constexpr uint32_t s_SynchronizeYields = 16;        // failed advances before Synchronize starts sleeping
+    static constexpr uint32_t s_SynchronizeMaxSleepUs = 1000;
+
+    struct alignas(g_CacheLineSize) Record
+    {
+        std::atomic<uint64_t> Epoch{ s_Quiescent };     // pinned epoch, s_Quiescent outside a guard
+        std::atomic<bool> InUse{ false };
+        Record* Next = nullptr;
+        // Owner thread only.
+        uint32_t Nesting = 0;
+        std::vector<Detail::RetiredObject> Retired;
+    };
+
+    struct ThreadExit
+    {
+        ~ThreadExit()
+        {
+            if (s_Record != nullptr && IsInitialized())
+            {
+                GetInstance().Unregister();
+            }
+        }
+    };
+
+    static inline thread_local Record* s_Record = nullptr;
+
+    alignas(g_CacheLineSize) std::atomic<uint64_t> m_Epoch{ 1 };
+    Detail::TThreadRecordList<Record> m_Records;
+    std::mutex m_OrphanMutex;
+    std::vector<Detail::RetiredObject> m_Orphans;     // left behind by exited threads
+    std::atomic<bool> m_HasOrphans{ false };
+
+protected:
+    EpochDomain() = default;
+    ~EpochDomain()
+    {
+        for (Record* record = m_Records.Head(); record != nullptr; record = record->Next)
+        {
+            Detail::DeleteRetiredObjects(record->Retired);
+        }
+        Detail::DeleteRetiredObjects(m_Orphans);
+    }
+
+public:
+    /// <summary>
+    /// Pin the current epoch. Nests, only the outermost Enter publishes anything.
+    /// </summary>
+    void Enter() noexcept
+    {
+        Record* record = CurrentRecord();
+        if (record->Nesting++ == 0)
+        {
+            record->Epoch.store(m_Epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+            // Keeps the reads of the section after the store here, TryAdvance issues the matching cpu barrier.
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        }
+    }
+    void Leave() noexcept
+    {
+        Record* record = s_Record;
+        SAssert(record != nullptr && record->Nesting > 0);
+        if (--record->Nesting == 0)
+        {
+            record->Epoch.store(s_Quiescent, std::memory_order_release);
+        }
+    }
+    bool IsInCriticalSection() const noexcept { return s_Record != nullptr && s_Record->Nesting > 0; }
+
+    /// <summary>
+    /// Hand over an object that is no longer reachable from shared memory, it is deleted once readers are done with it.
+    /// </summary>
+    template<typename T>
+    void Retire(T* object)
+    {
+        Retire(object, &Detail::DeleteRetired<T>);
+    }
+    void Retire(void* object, void (*deleter)(void*))
+    {
+        Record* record = CurrentRecord();
+        record->Retired.push_back({ object, deleter, m_Epoch.load(std::memory_order_seq_cst) });
+        if (record->Retired.size() >= s_CollectThreshold)
+        {
+            Collect(*record);
+        }
+    }
+
+    /// <summary>
+    /// Block until everything this thread retired so far is deleted. Must be called outside an EpochGuard.
+    /// Waits for a straggling reader with yields and then exponentially longer sleeps, and only pays the process wide
+    /// barrier again once the epoch has moved.
+    /// </summary>
+    void Synchronize()
+    {
+        SAssert(!IsInCriticalSection());
+        Record* record = CurrentRecord();
+        uint64_t target = m_Epoch.load(std::memory_order_seq_cst) + 2;
+        uint64_t fencedEpoch = s_Quiescent;
+        uint32_t failures = 0;
+        uint32_t sleepUs = 1;
+        while (m_Epoch.load(std::memory_order_acquire) < target)
+        {
+            if (TryAdvance(fencedEpoch))
+            {
+                failures = 0;
+                sleepUs = 1;
+            } else if (++failures <= s_SynchronizeYields)
+            {
+                std::this_thread::yield();
+            } else
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(sleepUs));
+                sleepUs = std::min(sleepUs * 2, s_SynchronizeMaxSleepUs);
+            }
+        }
+        Collect(*record);
+    }
+
+    uint64_t CurrentEpoch() const noexcept { return m_Epoch.load(std::memory_order_relaxed); }
+
+private:
+    Record* CurrentRecord()
+    {
+        Record* record = s_Record;
+        if (record == nullptr) [[unlikely]]
+        {
+            record = Register();
+        }
+        return record;
+    }
+
+    Record* Register()
+    {
+        static thread_local ThreadExit s_ThreadExit;
+        (void)s_ThreadExit;
+        s_Record = m_Records.Acquire();
+        return s_Record;
+    }
+
+    void Unregister()
+    {
+        Record* record = s_Record;
+        Collect(*record);
+        if (!record->Retired.empty())
+        {
+            std::lock_guard lock(m_OrphanMutex);
+            m_Orphans.insert(m_Orphans.end(), record->Retired.begin(), record->Retired.end());
+            m_HasOrphans.store(true, std::memory_order_relaxed);
+        }
+        record->Retired.clear();
+        record->Retired.shrink_to_fit();
+        s_Record = nullptr;
+        m_Records.Release(record);
+    }
+
+    // Move the global epoch on if every pinned reader has caught up with it.
+    bool TryAdvance() noexcept
+    {
+        uint64_t fencedEpoch = s_Quiescent;
+        return TryAdvance(fencedEpoch);
+    }
+    // fencedEpoch is the epoch the caller last issued the barrier for. A reader that entered after that barrier loaded
+    // at least that epoch, so while the epoch has not moved a rescan needs no new barrier.
+    bool TryAdvance(uint64_t& fencedEpoch) noexcept
+    {
+        uint64_t epoch = m_Epoch.load(std::memory_order_seq_cst);
+        if (epoch != fencedEpoch)
+        {
+            Platform::ProcessMemoryBarrier();
+            fencedEpoch = epoch;
+        }
+        for (Record* record = m_Records.Head(); record != nullptr; record = record->Next)
+        {
+            uint64_t pinned = record->Epoch.load(std::memory_order_acquire);
+            if (pinned != s_Quiescent && pinned != epoch)
+            {
+                return false;
+            }
+        }
+        m_Epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        return true;
+    }
+
+    void Collect(Record& record)
+    {
+        if (m_HasOrphans.load(std::memory_order_relaxed))
+        {
+            std::lock_guard lock(m_OrphanMutex);
+            record.Retired.insert(record.Retired.end(), m_Orphans.begin(), m_Orphans.end());
+            m_Orphans.clear();
+            m_HasOrphans.store(false, std::memory_order_relaxed);
+        }
+        TryAdvance();
+        uint64_t epoch = m_Epoch.load(std::memory_order_acquire);
+        auto pending = std::partition(record.Retired.begin(), record.Retired.end(),
+                                      [epoch](const Detail::RetiredObject& retired) { return retired.Epoch + 2 > epoch; });
+        std::vector<Detail::RetiredObject> expired(pending, record.Retired.end());
+        record.Retired.erase(pending, record.Retired.end());
+        Detail::DeleteRetiredObjects(expired);
+    }
+};
+
+/// <summary>
+/// Scoped EpochDomain::Enter / Leave. Pointers loaded from lock-free structures stay valid until it goes out of scope.
+/// </summary>
+class EpochGuard
+{
+private:
+    EpochDomain& m_Domain;
+
+public:
+    EpochGuard() : m_Domain(EpochDomain::GetInstance()) { m_Domain.Enter(); }
+    ~EpochGuard() { m_Domain.Leave(); }
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+// -------------------------------------------------------------
+// Hazard Pointers
+// -------------------------------------------------------------
+
+/// <summary>
+/// Process wide hazard pointer domain. Unlike epochs, a stalled reader only pins the objects it protects, so the amount
+/// of unreclaimed memory stays bounded. Each protect costs a store and a re-load of the source.
+/// </summary>
+class HazardDomain : public TSingleton<HazardDomain>
+{
+    friend class TSingleton<HazardDomain>;
+    friend class HazardPointer;
+
+public:
+    static constexpr uint32_t s_SlotsPerThread = 4;
+
+private:
+    static constexpr size_t s_MinScanThreshold = 64;
+
+    struct alignas(g_CacheLineSize) Record
+    {
+        std::atomic<const void*> Slots[s_SlotsPerThread]{};
+        std::atomic<bool> InUse{ false };
+        Record* Next = nullptr;
+        // Owner thread only.
+        uint32_t UsedSlots = 0;     // bit mask
+        std::vector<Detail::RetiredObject> Retired;
+        std::vector<const void*> Protected;     // scan scratch
+    };
+
+    struct ThreadExit
+    {
+        ~ThreadExit()
+        {
+            if (s_Record != nullptr && IsInitialized())
+            {
+                GetInstance().Unregister();
+            }
+        }
+    };
+
+    static inline thread_local Record* s_Record = nullptr;
+
+    Detail::TThreadRecordList<Record> m_Records;
+    std::atomic<size_t> m_RecordCount{ 0 };
+    std::mutex m_OrphanMutex;
+    std::vector<Detail::RetiredObject> m_Orphans;
+    std::atomic<bool> m_HasOrphans{ false };
+
+protected:
+    HazardDomain() = default;
+    ~HazardDomain()
+    {
+        for (Record* record = m_Records.Head(); record != nullptr; record = record->Next)
+        {
+            Detail::DeleteRetiredObjects(record->Retired);
+        }
+        Detail::DeleteRetiredObjects(m_Orphans);
+    }
+
+public:
+    template<typename T>
+    void Retire(T* object)
+    {
+        Retire(object, &Detail::DeleteRetired<T>);
+    }
+    void Retire(void* object, void (*deleter)(void*))
+    {
+        Record* record = CurrentRecord();
+        record->Retired.push_back({ object, deleter, 0 });
+        // Scan cost is amortized over a batch proportional to the number of hazard slots.
+        size_t threshold = std::max(s_MinScanThreshold, m_RecordCount.load(std::memory_order_relaxed) * s_SlotsPerThread * 2);
+        if (record->Retired.size() >= threshold)
+        {
+            Scan(*record);
+        }
+    }
+
+    /// <summary>
+    /// Delete whatever this thread retired that no hazard pointer protects right now.
+    /// </summary>
+    void Reclaim() { Scan(*CurrentRecord()); }
+
+private:
+    Record* CurrentRecord()
+    {
+        Record* record = s_Record;
+        if (record == nullptr) [[unlikely]]
+        {
+            static thread_local ThreadExit s_ThreadExit;
+            (void)s_ThreadExit;
+            record = m_Records.Acquire();
+            m_RecordCount.fetch_add(1, std::memory_order_relaxed);
+            s_Record = record;
+        }
+        return record;
+    }
+
+    std::atomic<const void*>* AcquireSlot()
+    {
+        Record* record = CurrentRecord();
+        SAssert(record->UsedSlots != (1u << s_SlotsPerThread) - 1);     // more than s_SlotsPerThread live HazardPointers
+        uint32_t index = std::countr_one(record->UsedSlots);
+        record->UsedSlots |= 1u << index;
+        return &record->Slots[index];
+    }
+    void ReleaseSlot(std::atomic<const void*>* slot) noexcept
+    {
+        Record* record = s_Record;
+        slot->store(nullptr, std::memory_order_release);
+        record->UsedSlots &= ~(1u << uint32_t(slot - record->Slots));
+    }
+
+    void Unregister()
+    {
+        Record* record = s_Record;
+        Scan(*record);
+        if (!record->Retired.empty())
+        {
+            std::lock_guard lock(m_OrphanMutex);
+            m_Orphans.insert(m_Orphans.end(), record->Retired.begin(), record->Retired.end());
+            m_HasOrphans.store(true, std::memory_order_relaxed);
+        }
+        record->Retired.clear();
+        record->Retired.shrink_to_fit();
+        record->Protected.clear();
+        record->Protected.shrink_to_fit();
+        s_Record = nullptr;
+        m_RecordCount.fetch_sub(1, std::memory_order_relaxed);
+        m_Records.Release(record);
+    }
+
+    void Scan(Record& record)
+    {
+        if (m_HasOrphans.load(std::memory_order_relaxed))
+        {
+            std::lock_guard lock(m_OrphanMutex);
+            record.Retired.insert(record.Retired.end(), m_Orphans.begin(), m_Orphans.end());
+            m_Orphans.clear();
+            m_HasOrphans.store(false, std::memory_order_relaxed);
+        }
+        // Pairs with the compiler fence in HazardPointer::Protect: a slot store we don't see here is followed by a
+        // re-load that sees the unlink.
+        Platform::ProcessMemoryBarrier();
+        record.Protected.clear();
+        for (Record* other = m_Records.Head(); other != nullptr; other = other->Next)
+        {
+            for (auto& slot : other->Slots)
+            {
+                if (const void* pointer = slot.load(std::memory_order_acquire))
+                {
+                    record.Protected.push_back(pointer);
+                }
+            }
+        }
+        std::sort(record.Protected.begin(), record.Protected.end());
+        auto pending = std::partition(record.Retired.begin(), record.Retired.end(), [&](const Detail::RetiredObject& retired) {
+            return std::binary_search(record.Protected.begin(), record.Protected.end(), static_cast<const void*>(retired.Object));
+        });
+        std::vector<Detail::RetiredObject> expired(pending, record.Retired.end());
+        record.Retired.erase(pending, record.Retired.end());
+        Detail::DeleteRetiredObjects(expired);
+    }
+};
+
+/// <summary>
+/// One hazard slot of the calling thread, at most HazardDomain::s_SlotsPerThread may be alive per thread.
+/// The pointer returned by Protect stays valid until Reset, the next Protect or destruction.
+/// </summary>
+class HazardPointer
+{
+private:
+    std::atomic<const void*>* m_Slot;
+
+public:
+    HazardPointer() : m_Slot(HazardDomain::GetInstance().AcquireSlot()) {}
+    ~HazardPointer() { HazardDomain::GetInstance().ReleaseSlot(m_Slot); }
+    HazardPointer(const HazardPointer&) = delete;
+    HazardPointer& operator=(const HazardPointer&) = delete;
+
+    template<typename T>
+    T* Protect(const std::atomic<T*>& source) noexcept
+    {
+        T* pointer = source.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            m_Slot->store(pointer, std::memory_order_relaxed);
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            T* current = source.load(std::memory_order_acquire);
+            if (current == pointer)
+            {
+                return pointer;
+            }
+            pointer = current;
+        }
+    }
+    void Reset() noexcept { m_Slot->store(nullptr, std::memory_order_release); }
+};
+
+// -------------------------------------------------------------
+// TRcuPtr
+// -------------------------------------------------------------
+
+/// <summary>
+/// Read-copy-update pointer for read-mostly shared data such as configuration or routing tables.
+/// Readers get a snapshot that stays valid for the life of the ReadGuard, at the cost of pinning the epoch.
+/// Writers are serialized, publish a whole new version and retire the old one to the EpochDomain.
+/// </summary>
+/// <typeparam name="T"> Value Type </typeparam>
+template<typename T>
+class TRcuPtr
+{
+private:
+    std::atomic<T*> m_Current{ nullptr };
+    HybridMutex m_WriterMutex;
+
+public:
+    class ReadGuard
+    {
+    private:
+        EpochGuard m_Guard;
+        const T* m_Value;
+
+    public:
+        explicit ReadGuard(const std::atomic<T*>& source) noexcept : m_Value(source.load(std::memory_order_acquire)) {}
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+        const T* Get() const noexcept { return m_Value; }
+        const T* operator->() const noexcept { return m_Value; }
+        const T& operator*() const noexcept { return *m_Value; }
+        explicit operator bool() const noexcept { return m_Value != nullptr; }
+    };
+
+    TRcuPtr() = default;
+    explicit TRcuPtr(UniqueHandle<T> value) noexcept : m_Current(value.release()) {}
+    TRcuPtr(const TRcuPtr&) = delete;
+    TRcuPtr& operator=(const TRcuPtr&) = delete;
+    // Readers must be gone, retired versions are left to the domain.
+    ~TRcuPtr() { delete m_Current.load(std::memory_order_relaxed); }
+
+    ReadGuard Read() const noexcept { return ReadGuard(m_Current); }
+
+    /// <summary>
+    /// For callers already inside an EpochGuard, e.g. to read several TRcuPtr under one pin.
+    /// </summary>
+    const T* Get() const noexcept
+    {
+        SAssert(EpochDomain::GetInstance().IsInCriticalSection());
+        return m_Current.load(std::memory_order_acquire);
+    }
+
+    void Store(UniqueHandle<T> value)
+    {
+        T* previous;
+        {
+            std::lock_guard lock(m_WriterMutex);
+            previous = m_Current.exchange(value.release(), std::memory_order_acq_rel);
+        }
+        RetireVersion(previous);
+    }
+
+    /// <summary>
+    /// Copy the current version, let fn(T&) modify the copy and publish it. Concurrent updates are serialized.
+    /// </summary>
+    template<typename Fn>
+    void Update(Fn&& fn)
+    {
+        T* previous;
+        {
+            std::lock_guard lock(m_WriterMutex);
+            previous = m_Current.load(std::memory_order_relaxed);
+            UniqueHandle<T> next = previous != nullptr ? MakeUnique<T>(*previous) : MakeUnique<T>();
+            fn(*next);
+            m_Current.store(next.release(), std::memory_order_release);
+        }
+        RetireVersion(previous);
+    }
+
+private:
+    static void RetireVersion(T* previous)
+    {
+        if (previous != nullptr)
+        {
+            EpochDomain::GetInstance().Retire(previous);
+        }
+    }
+};
+}
@@ -0,0 +1,472 @@
+﻿#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+#include "EnumFlags.hpp"
+#include "Platform.hpp"
+
+namespace Snowy
+{
+// -------------------------------------------------------------
+// Field Descriptors
+// -------------------------------------------------------------
+
+/// <summary>
+/// A struct opts into field-wise serialization by listing its members in order:
+///     static constexpr auto SerializeFields = std::tuple{ &Snapshot::Id, &Snapshot::Name, &Snapshot::State };
+/// Structs whose fields are all raw-copyable and that have no padding are copied with one memcpy instead.
+/// </summary>
+template<typename T>
+concept HasSerializeFields = requires { std::tuple_size<std::remove_cvref_t<decltype(T::SerializeFields)>>::value; };
+
+/// <summary>
+/// A struct without SerializeFields is copied as raw bytes only when it opts in with
+///     static constexpr bool SerializeRaw = true;
+/// which promises trivially copyable members without padding, pointers, strings or views.
+/// </summary>
+template<typename T>
+concept HasSerializeRaw = requires { requires T::SerializeRaw; };
+
+namespace Detail
+{
+template<typename T> struct TIsFlags : std::false_type {};
+template<typename BitType> struct TIsFlags<Flags<BitType>> : std::true_type {};
+
+template<typename T> struct TIsString : std::false_type {};
+template<IsChar CharT> struct TIsString<std::basic_string<CharT>> : std::true_type { using CharType = CharT; };
+template<IsChar CharT> struct TIsString<std::basic_string_view<CharT>> : std::true_type { using CharType = CharT; };
+
+template<typename T> struct TIsStdArray : std::false_type {};
+template<typename T, size_t N> struct TIsStdArray<std::array<T, N>> : std::true_type {};
+
+template<typename Class, typename Member>
+Member MemberType(Member Class::*);
+
+template<typename T, size_t... I>
+constexpr bool FieldsRawCopyable(std::index_sequence<I...>);
+}
+
+/// <summary>
+/// Bytes in memory equal the encoded bytes: scalars other than bool on a little-endian target, std::arrays of those,
+/// described structs whose fields all qualify, and structs that opt in with SerializeRaw.
+/// Pointers and string views are trivially copyable but refer to memory outside the value, they never qualify.
+/// </summary>
+template<typename T>
+constexpr bool g_IsRawSerializable = [] {
+    if constexpr (std::endian::native != std::endian::little || !std::is_trivially_copyable_v<T> || std::is_same_v<T, bool>
+                  || std::is_pointer_v<T> || std::is_member_pointer_v<T> || Detail::TIsString<T>::value)
+    {
+        return false;
+    } else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T> || Detail::TIsFlags<T>::value)
+    {
+        return true;
+    } else if constexpr (Detail::TIsStdArray<T>::value)
+    {
+        return g_IsRawSerializable<typename T::value_type>;
+    } else if constexpr (HasSerializeFields<T>)
+    {
+        constexpr size_t fieldCount = std::tuple_size_v<std::remove_cvref_t<decltype(T::SerializeFields)>>;
+        return Detail::FieldsRawCopyable<T>(std::make_index_sequence<fieldCount>());
+    } else
+    {
+        // Undescribed members can't be checked for pointers or views, so that takes an explicit promise.
+        return HasSerializeRaw<T>;
+    }
+}();
+
+namespace Detail
+{
+template<typename T, size_t... I>
+constexpr bool FieldsRawCopyable(std::index_sequence<I...>)
+{
+    // Every field raw, and the fields cover the struct exactly: no padding and nothing left out of the list.
+    return (g_IsRawSerializable<decltype(MemberType(std::get<I>(T::SerializeFields)))> && ...)
+        && (sizeof(decltype(MemberType(std::get<I>(T::SerializeFields)))) + ... + 0) == sizeof(T);
+}
+
+template<std::unsigned_integral U>
+constexpr U ByteSwap(U value) noexcept
+{
+    if constexpr (sizeof(U) == 1)
+    {
+        return value;
+    } else
+    {
+        U result = 0;
+        for (size_t i = 0; i < sizeof(U); ++i)
+        {
+            result = U(result << 8) | U(value & 0xFF);
+            value = U(value >> 8);
+        }
+        return result;
+    }
+}
+
+template<size_t Size> struct TUnsignedOfSize;
+template<> struct TUnsignedOfSize<1> { using Type = uint8_t; };
+template<> struct TUnsignedOfSize<2> { using Type = uint16_t; };
+template<> struct TUnsignedOfSize<4> { using Type = uint32_t; };
+template<> struct TUnsignedOfSize<8> { using Type = uint64_t; };
+
+template<typename T>
+inline T LittleEndian(T value) noexcept
+{
+    if constexpr (std::endian::native == std::endian::little)
+    {
+        return value;
+    } else
+    {
+        using U = typename TUnsignedOfSize<sizeof(T)>::Type;
+        return std::bit_cast<T>(ByteSwap(std::bit_cast<U>(value)));
+    }
+}
+}
+
+// -------------------------------------------------------------
+// BinaryWriter
+// -------------------------------------------------------------
+
+/// <summary>
+/// Appends a compact little-endian encoding to one contiguous growable buffer.
+/// Strings are a varint length followed by the code units, padded to the unit alignment so the reader can view them in place.
+/// </summary>
+class BinaryWriter
+{
+private:
+    std::vector<std::byte> m_Buffer;
+
+public:
+    BinaryWriter() = default;
+    explicit BinaryWriter(size_t capacity) { m_Buffer.reserve(capacity); }
+
+    ArrayIn<std::byte> Bytes() const noexcept { return m_Buffer; }
+    size_t Size() const noexcept { return m_Buffer.size(); }
+    void Reserve(size_t capacity) { m_Buffer.reserve(capacity); }
+    // Keeps the capacity, for reuse across messages.
+    void Clear() noexcept { m_Buffer.clear(); }
+    std::vector<std::byte> Release() noexcept { return std::exchange(m_Buffer, {}); }
+
+    void WriteBytes(ArrayIn<std::byte> bytes)
+    {
+        if (!bytes.empty())
+        {
+            std::memcpy(Append(bytes.size()), bytes.data(), bytes.size());
+        }
+    }
+
+    void WriteVarUInt(uint64_t value)
+    {
+        std::byte encoded[10];
+        size_t size = 0;
+        while (value >= 0x80)
+        {
+            encoded[size++] = std::byte(value | 0x80);
+            value >>= 7;
+        }
+        encoded[size++] = std::byte(value);
+        std::memcpy(Append(size), encoded, size);
+    }
+    // Zigzag encoded so small negative values stay short.
+    void WriteVarInt(int64_t value)
+    {
+        WriteVarUInt((uint64_t(value) << 1) ^ uint64_t(value >> 63));
+    }
+
+    template<IsChar CharT>
+    void WriteString(std::basic_string_view<CharT> text)
+    {
+        WriteVarUInt(text.size());
+        Pad(alignof(CharT));
+        if constexpr (sizeof(CharT) == 1 || std::endian::native == std::endian::little)
+        {
+            WriteBytes(std::as_bytes(std::span(text)));
+        } else
+        {
+            for (CharT c : text)
+            {
+                Write(c);
+            }
+        }
+    }
+
+    /// <summary>
+    /// Count followed by the elements. Raw-serializable elements are aligned and copied in one block so the reader can
+    /// return a span over them.
+    /// </summary>
+    template<typename T>
+    void WriteArray(ArrayIn<T> values)
+    {
+        WriteVarUInt(values.size());
+        if constexpr (g_IsRawSerializable<T>)
+        {
+            Pad(alignof(T));
+            WriteBytes(std::as_bytes(values));
+        } else
+        {
+            for (const T& value : values)
+            {
+                Write(value);
+            }
+        }
+    }
+
+    /// <summary>
+    /// Scalars, enums, Flags, strings, described structs and structs that opt in with SerializeRaw.
+    /// </summary>
+    template<typename T>
+    void Write(const T& value)
+    {
+        if constexpr (Detail::TIsString<T>::value)
+        {
+            WriteString(std::basic_string_view<typename Detail::TIsString<T>::CharType>(value));
+        } else if constexpr (g_IsRawSerializable<T>)
+        {
+            std::memcpy(Append(sizeof(T)), &value, sizeof(T));
+        } else if constexpr (Detail::TIsFlags<T>::value)
+        {
+            Write(value.Value());
+        } else if constexpr (std::is_same_v<T, bool>)
+        {
+            Write(uint8_t(value));
+        } else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>)
+        {
+            T little = Detail::LittleEndian(value);
+            std::memcpy(Append(sizeof(T)), &little, sizeof(T));
+        } else if constexpr (HasSerializeFields<T>)
+        {
+            std::apply([&](auto... fields) { (Write(value.*fields), ...); }, T::SerializeFields);
+        } else
+        {
+            static_assert(!sizeof(T), "Type is not serializable, list its fields in SerializeFields or declare SerializeRaw.");
+        }
+    }
+
+private:
+    std::byte* Append(size_t size)
+    {
+        size_t offset = m_Buffer.size();
+        m_Buffer.resize(offset + size);
+        return m_Buffer.data() + offset;
+    }
+
+    void Pad(size_t alignment)
+    {
+        size_t padding = (alignment - m_Buffer.size() % alignment) % alignment;
+        if (padding != 0)
+        {
+            std::memset(Append(padding), 0, padding);
+        }
+    }
+};
+
+// -------------------------------------------------------------
+// BinaryReader
+// -------------------------------------------------------------
+
+/// <summary>
+/// Decodes BinaryWriter output in place. Strings and raw arrays come back as views into the source bytes, which must outlive them.
+/// Running past the end or meeting a malformed value fails the reader: it stays failed and later reads return empty values.
+/// The source must start at the same alignment the writer's buffer had, heap and mapped memory both do.
+/// </summary>
+class BinaryReader
+{
+private:
+    ArrayIn<std::byte> m_Bytes;
+    size_t m_Position = 0;
+    bool m_Failed = false;
+
+public:
+    BinaryReader() = default;
+    explicit BinaryReader(ArrayIn<std::byte> bytes) noexcept : m_Bytes(bytes) {}
+    explicit BinaryReader(const MappedFile& file) noexcept : m_Bytes(file.Bytes()) {}
+
+    bool Ok() const noexcept { return !m_Failed; }
+    bool AtEnd() const noexcept { return m_Position == m_Bytes.size(); }
+    size_t Position() const noexcept { return m_Position; }
+    size_t Remaining() const noexcept { return m_Bytes.size() - m_Position; }
+
+    ArrayIn<std::byte> ReadBytes(size_t size) noexcept
+    {
+        const std::byte* data = Consume(size);
+        return data != nullptr ? ArrayIn<std::byte>(data, size) : ArrayIn<std::byte>();
+    }
+    void Skip(size_t size) noexcept { Consume(size); }
+
+    uint64_t ReadVarUInt() noexcept
+    {
+        uint64_t value = 0;
+        for (uint32_t shift = 0; shift < 64 && !m_Failed; shift += 7)
+        {
+            const std::byte* data = Consume(1);
+            if (data == nullptr)
+            {
+                break;
+            }
+            uint64_t bits = std::to_integer<uint64_t>(*data);
+            value |= (bits & 0x7F) << shift;
+            if ((bits & 0x80) == 0)
+            {
+                return value;
+            }
+        }
+        m_Failed = true;
+        return 0;
+    }
+    int64_t ReadVarInt() noexcept
+    {
+        uint64_t value = ReadVarUInt();
+        return int64_t(value >> 1) ^ -int64_t(value & 1);
+    }
+
+    /// <summary>
+    /// View of the string in place, on big-endian targets wide strings need ReadString into a string instead.
+    /// </summary>
+    template<IsChar CharT = SChar>
+    std::basic_string_view<CharT> ReadStringView() noexcept
+    {
+        static_assert(sizeof(CharT) == 1 || std::endian::native == std::endian::little, "Wide string views need a little-endian target.");
+        ArrayIn<CharT> units = ReadUnits<CharT>();
+        return std::basic_string_view<CharT>(units.data(), units.size());
+    }
+
+    /// <summary>
+    /// Count written by WriteArray, then a span over the elements in place. Only for raw-serializable T.
+    /// </summary>
+    template<typename T>
+    ArrayIn<T> ReadArrayView() noexcept
+    {
+        static_assert(g_IsRawSerializable<T>, "Only raw-serializable elements can be viewed in place.");
+        return ReadUnits<T>();
+    }
+    template<typename T>
+    std::vector<T> ReadArray()
+    {
+        std::vector<T> values;
+        if constexpr (g_IsRawSerializable<T>)
+        {
+            ArrayIn<T> view = ReadArrayView<T>();
+            values.assign(view.begin(), view.end());
+        } else
+        {
+            uint64_t count = ReadVarUInt();
+            // Every element takes at least a byte, which bounds the reservation on malformed input.
+            values.reserve(size_t(std::min<uint64_t>(count, Remaining())));
+            for (uint64_t i = 0; i < count && !m_Failed; ++i)
+            {
+                values.push_back(Read<T>());
+            }
+        }
+        return values;
+    }
+
+    /// <summary>
+    /// Counterpart of BinaryWriter::Write. String views point into the source, strings are copied.
+    /// </summary>
+    template<typename T>
+    void Read(T& value)
+    {
+        if constexpr (Detail::TIsString<T>::value)
+        {
+            using CharT = typename Detail::TIsString<T>::CharType;
+            if constexpr (sizeof(CharT) == 1 || std::endian::native == std::endian::little)
+            {
+                value = ReadStringView<CharT>();
+            } else
+            {
+                uint64_t size = ReadVarUInt();
+                PadTo(alignof(CharT));
+                value.clear();
+                for (uint64_t i = 0; i < size && !m_Failed; ++i)
+                {
+                    value.push_back(Read<CharT>());
+                }
+            }
+        } else if constexpr (g_IsRawSerializable<T>)
+        {
+            if (const std::byte* data = Consume(sizeof(T)))
+            {
+                std::memcpy(&value, data, sizeof(T));
+            }
+        } else if constexpr (Detail::TIsFlags<T>::value)
+        {
+            value = T(Read<typename T::MaskType>());
+        } else if constexpr (std::is_same_v<T, bool>)
+        {
+            value = Read<uint8_t>() != 0;
+        } else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>)
+        {
+            const std::byte* data = Consume(sizeof(T));
+            T little{};
+            if (data != nullptr)
+            {
+                std::memcpy(&little, data, sizeof(T));
+            }
+            value = Detail::LittleEndian(little);
+        } else if constexpr (HasSerializeFields<T>)
+        {
+            std::apply([&](auto... fields) { (Read(value.*fields), ...); }, T::SerializeFields);
+        } else
+        {
+            static_assert(!sizeof(T), "Type is not serializable, list its fields in SerializeFields or declare SerializeRaw.");
+        }
+    }
+    template<typename T>
+    T Read()
+    {
+        T value{};
+        Read(value);
+        return value;
+    }
+
+private:
+    const std::byte* Consume(size_t size) noexcept
+    {
+        if (m_Failed || size > Remaining())
+        {
+            m_Failed = true;
+            return nullptr;
+        }
+        const std::byte* data = m_Bytes.data() + m_Position;
+        m_Position += size;
+        return data;
+    }
+
+    void PadTo(size_t alignment) noexcept
+    {
+        Skip((alignment - m_Position % alignment) % alignment);
+    }
+
+    template<typename T>
+    ArrayIn<T> ReadUnits() noexcept
+    {
+        uint64_t count = ReadVarUInt();
+        PadTo(alignof(T));
+        if (m_Failed || count > Remaining() / sizeof(T))
+        {
+            m_Failed = true;
+            return {};
+        }
+        const std::byte* data = Consume(size_t(count) * sizeof(T));
+        if (reinterpret_cast<uintptr_t>(data) % alignof(T) != 0)
+        {
+            m_Failed = true;
+            return {};
+        }
+        return ArrayIn<T>(reinterpret_cast<const T*>(data), size_t(count));
+    }
+};
+}
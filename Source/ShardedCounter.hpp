@@ -0,0 +1,187 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <type_traits>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+
+namespace Snowy
+{
+enum class ShardPolicy : uint8_t
+{
+    Thread,     // a fixed shard per thread, dealt round robin
+    Processor,  // the shard of the core the thread currently runs on
+};
+
+namespace Detail
+{
+// One shard per hardware thread rounded up to a power of two, so picking one is a mask.
+inline uint32_t ShardCount() noexcept
+{
+    static const uint32_t s_Count = std::bit_ceil(std::clamp(std::thread::hardware_concurrency(), 1u, 256u));
+    return s_Count;
+}
+
+template<ShardPolicy Policy>
+uint32_t CurrentShard() noexcept
+{
+    if constexpr (Policy == ShardPolicy::Processor)
+    {
+        return Platform::CurrentProcessor() & (ShardCount() - 1);
+    }
+    else
+    {
+        static std::atomic<uint32_t> s_NextShard{ 0 };
+        static thread_local uint32_t s_Shard = s_NextShard.fetch_add(1, std::memory_order_relaxed);
+        return s_Shard & (ShardCount() - 1);
+    }
+}
+}
+
+/// <summary>
+/// Counter split over cache line padded shards. Add is a relaxed fetch_add on a line that is almost never shared,
+/// Read sums the shards and is the expensive side. Read is not a snapshot, concurrent Adds may or may not be counted.
+/// </summary>
+/// <typeparam name="T"> Value Type </typeparam>
+/// <typeparam name="Policy"> How a thread picks its shard </typeparam>
+template<typename T = uint64_t, ShardPolicy Policy = ShardPolicy::Thread>
+class TShardedCounter
+{
+    static_assert(std::is_arithmetic_v<T>, "TShardedCounter needs an arithmetic value type.");
+
+private:
+    struct alignas(g_CacheLineSize) Shard
+    {
+        std::atomic<T> Value{ T(0) };
+    };
+
+    UniqueHandle<Shard[]> m_Shards;
+
+public:
+    TShardedCounter() : m_Shards(MakeUnique<Shard[]>(Detail::ShardCount())) {}
+    TShardedCounter(const TShardedCounter&) = delete;
+    TShardedCounter& operator=(const TShardedCounter&) = delete;
+
+    void Add(T delta) noexcept { m_Shards[Detail::CurrentShard<Policy>()].Value.fetch_add(delta, std::memory_order_relaxed); }
+    void Increment() noexcept { Add(T(1)); }
+    void Decrement() noexcept { Add(T(-1)); }
+    TShardedCounter& operator+=(T delta) noexcept { Add(delta); return *this; }
+    TShardedCounter& operator++() noexcept { Add(T(1)); return *this; }
+
+    T Read() const noexcept
+    {
+        T sum = T(0);
+        for (uint32_t i = 0; i < Detail::ShardCount(); ++i)
+        {
+            sum += m_Shards[i].Value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    /// <summary>
+    /// Zero the counter and return what it held, Adds racing with it land either before or after.
+    /// </summary>
+    T Exchange() noexcept
+    {
+        T sum = T(0);
+        for (uint32_t i = 0; i < Detail::ShardCount(); ++i)
+        {
+            sum += m_Shards[i].Value.exchange(T(0), std::memory_order_relaxed);
+        }
+        return sum;
+    }
+    void Reset() noexcept { Exchange(); }
+};
+
+template<typename T>
+struct TGaugeSnapshot
+{
+    uint64_t Count = 0;
+    T Sum = T(0);
+    T Min = std::numeric_limits<T>::max();
+    T Max = std::numeric_limits<T>::lowest();
+
+    double Mean() const noexcept { return Count != 0 ? double(Sum) / double(Count) : 0.0; }
+};
+
+/// <summary>
+/// Sharded count / sum / min / max of recorded samples. Min and max only write when the sample improves on the shard,
+/// so steady state recording is two relaxed fetch_adds on the thread's own line.
+/// </summary>
+/// <typeparam name="T"> Sample Type </typeparam>
+/// <typeparam name="Policy"> How a thread picks its shard </typeparam>
+template<typename T = int64_t, ShardPolicy Policy = ShardPolicy::Thread>
+class TShardedGauge
+{
+    static_assert(std::is_arithmetic_v<T>, "TShardedGauge needs an arithmetic sample type.");
+
+private:
+    struct alignas(g_CacheLineSize) Shard
+    {
+        std::atomic<uint64_t> Count{ 0 };
+        std::atomic<T> Sum{ T(0) };
+        std::atomic<T> Min{ std::numeric_limits<T>::max() };
+        std::atomic<T> Max{ std::numeric_limits<T>::lowest() };
+    };
+
+    UniqueHandle<Shard[]> m_Shards;
+
+public:
+    TShardedGauge() : m_Shards(MakeUnique<Shard[]>(Detail::ShardCount())) {}
+    TShardedGauge(const TShardedGauge&) = delete;
+    TShardedGauge& operator=(const TShardedGauge&) = delete;
+
+    void Record(T sample) noexcept
+    {
+        Shard& shard = m_Shards[Detail::CurrentShard<Policy>()];
+        shard.Count.fetch_add(1, std::memory_order_relaxed);
+        shard.Sum.fetch_add(sample, std::memory_order_relaxed);
+        for (T min = shard.Min.load(std::memory_order_relaxed);
+             sample < min && !shard.Min.compare_exchange_weak(min, sample, std::memory_order_relaxed);)
+        {
+        }
+        for (T max = shard.Max.load(std::memory_order_relaxed);
+             sample > max && !shard.Max.compare_exchange_weak(max, sample, std::memory_order_relaxed);)
+        {
+        }
+    }
+
+    TGaugeSnapshot<T> Read() const noexcept
+    {
+        TGaugeSnapshot<T> snapshot;
+        for (uint32_t i = 0; i < Detail::ShardCount(); ++i)
+        {
+            const Shard& shard = m_Shards[i];
+            snapshot.Count += shard.Count.load(std::memory_order_relaxed);
+            snapshot.Sum += shard.Sum.load(std::memory_order_relaxed);
+            snapshot.Min = std::min(snapshot.Min, shard.Min.load(std::memory_order_relaxed));
+            snapshot.Max = std::max(snapshot.Max, shard.Max.load(std::memory_order_relaxed));
+        }
+        return snapshot;
+    }
+
+    /// <summary>
+    /// Start a new window. Samples recorded concurrently may be split between the windows.
+    /// </summary>
+    void Reset() noexcept
+    {
+        for (uint32_t i = 0; i < Detail::ShardCount(); ++i)
+        {
+            Shard& shard = m_Shards[i];
+            shard.Count.store(0, std::memory_order_relaxed);
+            shard.Sum.store(T(0), std::memory_order_relaxed);
+            shard.Min.store(std::numeric_limits<T>::max(), std::memory_order_relaxed);
+            shard.Max.store(std::numeric_limits<T>::lowest(), std::memory_order_relaxed);
+        }
+    }
+};
+
+using ShardedCounter = TShardedCounter<>;
+using ShardedGauge = TShardedGauge<>;
+}
@@ -1,15 +1,124 @@
 ﻿#pragma once
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "Misc.hpp"
+
 namespace Snowy
 {
-template<typename T>
+/// <summary>
+/// Owns the lifetime of every TSingleton: records construction order and destroys in reverse on Shutdown,
+/// so a singleton always goes before the singletons it depends on. Anything still alive at exit is shut down then.
+/// </summary>
+class SingletonRegistry
+{
+private:
+	std::recursive_mutex m_Mutex;
+	std::vector<void(*)()> m_Destroyers;	// construction order
+
+	SingletonRegistry() = default;
+	~SingletonRegistry() { ShutdownAll(); }
+
+	static SingletonRegistry& Get()
+	{
+		static SingletonRegistry s_Registry;
+		return s_Registry;
+	}
+
+	template<typename, typename...> friend class TSingleton;
+
+public:
+	/// <summary>
+	/// Eager warm-up: construct the listed singletons and their dependencies now, e.g. at startup,
+	/// instead of at first use in a latency sensitive path.
+	/// </summary>
+	template<typename... Singletons>
+	static void Initialize()
+	{
+		(Singletons::Initialize(), ...);
+	}
+
+	/// <summary>
+	/// Destroy every live singleton, last constructed first.
+	/// </summary>
+	static void Shutdown()
+	{
+		Get().ShutdownAll();
+	}
+
+private:
+	void ShutdownAll()
+	{
+		// Destructors run outside the lock: they may block on threads which are themselves initializing a singleton.
+		for (;;)
+		{
+			void (*destroy)() = nullptr;
+			{
+				std::lock_guard lock(m_Mutex);
+				if (m_Destroyers.empty())
+				{
+					return;
+				}
+				destroy = m_Destroyers.back();
+				m_Destroyers.pop_back();
+			}
+			destroy();
+		}
+	}
+};
+
+/// <summary>
+/// Singleton base, derive as class T : public TSingleton<T, Dependencies...>.
+/// Initialize() constructs the dependencies first, then T, in static storage. GetInstance() is one pointer load, with
+/// a cold fallback to Initialize() if nothing warmed it up, instead of the guard of a function-local static.
+/// </summary>
+/// <typeparam name="T"> Singleton Type </typeparam>
+/// <typeparam name="Dependencies"> Singletons constructed before and destroyed after T </typeparam>
+template<typename T, typename... Dependencies>
 class TSingleton
 {
+private:
+	static inline std::atomic<T*> s_Instance{ nullptr };
+	static inline std::mutex s_Mutex;	// serializes construction and destruction of this T only
+
 public:
 	static T& GetInstance()
 	{
-		static T instance;
+		T* instance = s_Instance.load(std::memory_order_acquire);
+		if (instance == nullptr) [[unlikely]]
+		{
+			instance = Initialize();
+		}
+		return *instance;
+	}
+	static bool IsInitialized() noexcept { return s_Instance.load(std::memory_order_acquire) != nullptr; }
+
+	/// <summary>
+	/// Construct the dependencies and then the instance if not done yet. Safe to call from several threads; T() runs
+	/// under a lock of its own, so unrelated singletons can be constructed concurrently.
+	/// </summary>
+	static T* Initialize()
+	{
+		(Dependencies::Initialize(), ...);
+		std::lock_guard lock(s_Mutex);
+		if (T* instance = s_Instance.load(std::memory_order_relaxed))
+		{
+			return instance;
+		}
+		T* instance = ::new (static_cast<void*>(Storage())) T();
+		SingletonRegistry& registry = SingletonRegistry::Get();
+		{
+			// Registered after T() returns, so anything T() initialized is destroyed after T.
+			std::lock_guard registryLock(registry.m_Mutex);
+			registry.m_Destroyers.push_back(&Destroy);
+		}
+		s_Instance.store(instance, std::memory_order_release);
 		return instance;
 	}
+
 	TSingleton(const TSingleton&) = delete;
 	TSingleton(TSingleton&&) = delete;
 	TSingleton& operator=(const TSingleton&) = delete;
@@ -17,5 +126,69 @@ public:
 protected:
 	TSingleton() = default;
 	~TSingleton() = default;
+
+private:
+	// Constant initialized, so there is no guard, and it's only instantiated once T is complete.
+	static std::byte* Storage() noexcept
+	{
+		alignas(T) static std::byte s_Storage[sizeof(T)];
+		return s_Storage;
+	}
+	static void Destroy()
+	{
+		std::lock_guard lock(s_Mutex);
+		T* instance = s_Instance.exchange(nullptr, std::memory_order_acq_rel);
+		SAssert(instance != nullptr);
+		instance->~T();
+	}
+};
+
+/// <summary>
+/// One instance per thread, created on the thread's first GetInstance and destroyed at thread exit.
+/// The fast path reads a trivially initialized thread_local pointer, so it has no TLS init check either.
+/// </summary>
+/// <typeparam name="T"> Singleton Type </typeparam>
+template<typename T>
+class TThreadLocalSingleton
+{
+private:
+	static inline thread_local T* s_Instance = nullptr;
+
+	struct Holder
+	{
+		T* Instance = nullptr;
+		~Holder()
+		{
+			delete Instance;
+			s_Instance = nullptr;
+		}
+	};
+
+public:
+	static T& GetInstance()
+	{
+		T* instance = s_Instance;
+		if (instance == nullptr) [[unlikely]]
+		{
+			instance = Create();
+		}
+		return *instance;
+	}
+	static bool IsInitialized() noexcept { return s_Instance != nullptr; }
+
+	TThreadLocalSingleton(const TThreadLocalSingleton&) = delete;
+	TThreadLocalSingleton& operator=(const TThreadLocalSingleton&) = delete;
+protected:
+	TThreadLocalSingleton() = default;
+	~TThreadLocalSingleton() = default;
+
+private:
+	static T* Create()
+	{
+		static thread_local Holder s_Holder;
+		s_Holder.Instance = new T();
+		s_Instance = s_Holder.Instance;
+		return s_Instance;
+	}
 };
 }
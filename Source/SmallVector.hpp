@@ -0,0 +1,335 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+
+namespace Snowy
+{
+/// <summary>
+/// Tells containers whether T can be moved to a new address with a plain memcpy (and no dtor call on the source).
+/// Specialize it for types which are not trivially copyable but are still safe to relocate bitwise.
+/// </summary>
+template<typename T>
+struct RelocateTraits
+{
+    static constexpr bool IsTrivial = std::is_trivially_copyable_v<T>;
+};
+template<typename T> struct RelocateTraits<UniqueHandle<T>> { static constexpr bool IsTrivial = true; };
+template<typename T> struct RelocateTraits<SharedHandle<T>> { static constexpr bool IsTrivial = true; };
+template<typename T> struct RelocateTraits<WeakHandle<T>> { static constexpr bool IsTrivial = true; };
+
+/// <summary>
+/// Move-construct n elements from src into uninitialized dst, then destroy the sources.
+/// Can't fail halfway, so T must be trivially relocatable or have a noexcept move constructor.
+/// </summary>
+template<typename T>
+inline void RelocateN(T* src, size_t n, T* dst) noexcept
+{
+    static_assert(RelocateTraits<T>::IsTrivial || std::is_nothrow_move_constructible_v<T>,
+                  "Relocated elements need a noexcept move constructor or a RelocateTraits specialization.");
+    if constexpr (RelocateTraits<T>::IsTrivial)
+    {
+        if (n != 0)
+        {
+            std::memcpy(static_cast<void*>(dst), static_cast<const void*>(src), n * sizeof(T));
+        }
+    } else
+    {
+        std::uninitialized_move_n(src, n, dst);
+        std::destroy_n(src, n);
+    }
+}
+
+/// <summary>
+/// Vector with inline storage for the first N elements, spills to heap only when it grows beyond that.
+/// Elements must be nothrow movable or trivially relocatable, growth and moves never copy.
+/// </summary>
+/// <typeparam name="T"> Element Type </typeparam>
+/// <typeparam name="N"> Inline Capacity </typeparam>
+template<typename T, size_t N = 8>
+class TSmallVector
+{
+public:
+    using ValueType = T;
+    using Iterator = T*;
+    using ConstIterator = const T*;
+    static constexpr size_t InlineCapacity = N;
+
+private:
+    T* m_Data;
+    size_t m_Size = 0;
+    size_t m_Capacity = N;
+    alignas(T) std::byte m_Inline[sizeof(T) * (N != 0 ? N : 1)];
+
+public:
+    TSmallVector() noexcept : m_Data(InlineData()) {}
+    explicit TSmallVector(size_t count) : TSmallVector() { Resize(count); }
+    TSmallVector(size_t count, In<T> value) : TSmallVector() { Resize(count, value); }
+    TSmallVector(std::initializer_list<T> list) : TSmallVector() { Append(ArrayIn<T>(list.begin(), list.size())); }
+    explicit TSmallVector(ArrayIn<T> items) : TSmallVector() { Append(items); }
+    TSmallVector(const TSmallVector& other) : TSmallVector() { Append(ArrayIn<T>(other)); }
+    TSmallVector(TSmallVector&& other) noexcept : TSmallVector() { Steal(std::move(other)); }
+    ~TSmallVector()
+    {
+        Clear();
+        FreeHeap();
+    }
+
+    TSmallVector& operator=(const TSmallVector& other)
+    {
+        if (this != &other)
+        {
+            Clear();
+            Append(ArrayIn<T>(other));
+        }
+        return *this;
+    }
+    TSmallVector& operator=(TSmallVector&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Clear();
+            FreeHeap();
+            Steal(std::move(other));
+        }
+        return *this;
+    }
+    TSmallVector& operator=(std::initializer_list<T> list)
+    {
+        Clear();
+        Append(ArrayIn<T>(list.begin(), list.size()));
+        return *this;
+    }
+
+    bool operator==(const TSmallVector& other) const
+    {
+        return std::equal(begin(), end(), other.begin(), other.end());
+    }
+
+    operator ArrayIn<T>() const noexcept { return ArrayIn<T>(m_Data, m_Size); }
+    operator std::span<T>() noexcept { return std::span<T>(m_Data, m_Size); }
+
+    T& operator[](size_t index) noexcept { SAssert(index < m_Size); return m_Data[index]; }
+    const T& operator[](size_t index) const noexcept { SAssert(index < m_Size); return m_Data[index]; }
+
+    T& Front() noexcept { SAssert(m_Size != 0); return m_Data[0]; }
+    T& Back() noexcept { SAssert(m_Size != 0); return m_Data[m_Size - 1]; }
+    const T& Front() const noexcept { SAssert(m_Size != 0); return m_Data[0]; }
+    const T& Back() const noexcept { SAssert(m_Size != 0); return m_Data[m_Size - 1]; }
+
+    T* Data() noexcept { return m_Data; }
+    const T* Data() const noexcept { return m_Data; }
+    size_t Size() const noexcept { return m_Size; }
+    size_t Capacity() const noexcept { return m_Capacity; }
+    bool Empty() const noexcept { return m_Size == 0; }
+    bool IsInline() const noexcept { return m_Data == InlineData(); }
+
+    Iterator begin() noexcept { return m_Data; }
+    Iterator end() noexcept { return m_Data + m_Size; }
+    ConstIterator begin() const noexcept { return m_Data; }
+    ConstIterator end() const noexcept { return m_Data + m_Size; }
+
+    template<typename... Args>
+    T& EmplaceBack(Args&&... args)
+    {
+        if (m_Size == m_Capacity)
+        {
+            // Construct into the new block first, args may alias an element of the old one.
+            size_t newCapacity = NextCapacity(m_Size + 1);
+            T* newData = Allocate(newCapacity);
+            try
+            {
+                ::new (static_cast<void*>(newData + m_Size)) T(std::forward<Args>(args)...);
+            } catch (...)
+            {
+                Deallocate(newData, newCapacity);
+                throw;
+            }
+            RelocateN(m_Data, m_Size, newData);
+            FreeHeap();
+            m_Data = newData;
+            m_Capacity = newCapacity;
+        } else
+        {
+            ::new (static_cast<void*>(m_Data + m_Size)) T(std::forward<Args>(args)...);
+        }
+        return m_Data[m_Size++];
+    }
+    void PushBack(In<T> value) { EmplaceBack(value); }
+    void PushBack(T&& value) { EmplaceBack(std::move(value)); }
+    void PopBack() noexcept
+    {
+        SAssert(m_Size != 0);
+        std::destroy_at(m_Data + --m_Size);
+    }
+
+    void Append(ArrayIn<T> items)
+    {
+        if (m_Size + items.size() > m_Capacity)
+        {
+            // Copy into the new block first, items may be a view of this vector.
+            size_t newCapacity = NextCapacity(m_Size + items.size());
+            T* newData = Allocate(newCapacity);
+            try
+            {
+                std::uninitialized_copy(items.begin(), items.end(), newData + m_Size);
+            } catch (...)
+            {
+                Deallocate(newData, newCapacity);
+                throw;
+            }
+            RelocateN(m_Data, m_Size, newData);
+            FreeHeap();
+            m_Data = newData;
+            m_Capacity = newCapacity;
+        } else
+        {
+            std::uninitialized_copy(items.begin(), items.end(), m_Data + m_Size);
+        }
+        m_Size += items.size();
+    }
+
+    Iterator Insert(ConstIterator pos, T value)
+    {
+        size_t index = static_cast<size_t>(pos - m_Data);
+        SAssert(index <= m_Size);
+        EmplaceBack(std::move(value));
+        std::rotate(m_Data + index, m_Data + m_Size - 1, m_Data + m_Size);
+        return m_Data + index;
+    }
+    Iterator Erase(ConstIterator pos)
+    {
+        size_t index = static_cast<size_t>(pos - m_Data);
+        SAssert(index < m_Size);
+        std::move(m_Data + index + 1, m_Data + m_Size, m_Data + index);
+        PopBack();
+        return m_Data + index;
+    }
+    /// <summary>
+    /// O(1) erase which doesn't keep the order, moves the last element into the hole.
+    /// </summary>
+    Iterator SwapErase(ConstIterator pos)
+    {
+        size_t index = static_cast<size_t>(pos - m_Data);
+        SAssert(index < m_Size);
+        if (index != m_Size - 1)
+        {
+            m_Data[index] = std::move(m_Data[m_Size - 1]);
+        }
+        PopBack();
+        return m_Data + index;
+    }
+
+    void Clear() noexcept
+    {
+        std::destroy_n(m_Data, m_Size);
+        m_Size = 0;
+    }
+    void Reserve(size_t capacity)
+    {
+        if (capacity > m_Capacity)
+        {
+            Grow(capacity);
+        }
+    }
+    void Resize(size_t size)
+    {
+        Reserve(size);
+        if (size > m_Size)
+        {
+            std::uninitialized_value_construct(m_Data + m_Size, m_Data + size);
+        } else
+        {
+            std::destroy(m_Data + size, m_Data + m_Size);
+        }
+        m_Size = size;
+    }
+    void Resize(size_t size, In<T> value)
+    {
+        if (size > m_Size)
+        {
+            if (size > m_Capacity)
+            {
+                // value may live inside this vector, keep a copy across the reallocation.
+                T copy = value;
+                Grow(size);
+                std::uninitialized_fill(m_Data + m_Size, m_Data + size, copy);
+            } else
+            {
+                std::uninitialized_fill(m_Data + m_Size, m_Data + size, value);
+            }
+        } else
+        {
+            std::destroy(m_Data + size, m_Data + m_Size);
+        }
+        m_Size = size;
+    }
+    /// <summary>
+    /// Move heap elements back into the inline buffer when they fit, otherwise shrink the heap block.
+    /// </summary>
+    void ShrinkToFit()
+    {
+        if (IsInline() || m_Size == m_Capacity)
+        {
+            return;
+        }
+        T* newData = m_Size <= N ? InlineData() : Allocate(m_Size);
+        RelocateN(m_Data, m_Size, newData);
+        FreeHeap();
+        m_Data = newData;
+        m_Capacity = newData == InlineData() ? N : m_Size;
+    }
+
+private:
+    T* InlineData() noexcept { return reinterpret_cast<T*>(m_Inline); }
+    const T* InlineData() const noexcept { return reinterpret_cast<const T*>(m_Inline); }
+
+    static T* Allocate(size_t capacity) { return std::allocator<T>().allocate(capacity); }
+    static void Deallocate(T* data, size_t capacity) noexcept { std::allocator<T>().deallocate(data, capacity); }
+
+    size_t NextCapacity(size_t required) const noexcept
+    {
+        return std::max(required, m_Capacity * 2);
+    }
+    void Grow(size_t required)
+    {
+        size_t newCapacity = NextCapacity(required);
+        T* newData = Allocate(newCapacity);
+        RelocateN(m_Data, m_Size, newData);
+        FreeHeap();
+        m_Data = newData;
+        m_Capacity = newCapacity;
+    }
+    void FreeHeap() noexcept
+    {
+        if (!IsInline())
+        {
+            Deallocate(m_Data, m_Capacity);
+            m_Data = InlineData();
+            m_Capacity = N;
+        }
+    }
+    // Expects *this to be empty and inline.
+    void Steal(TSmallVector&& other) noexcept
+    {
+        if (other.IsInline())
+        {
+            RelocateN(other.m_Data, other.m_Size, m_Data);
+        } else
+        {
+            m_Data = other.m_Data;
+            m_Capacity = other.m_Capacity;
+            other.m_Data = other.InlineData();
+            other.m_Capacity = N;
+        }
+        m_Size = other.m_Size;
+        other.m_Size = 0;
+    }
+};
+}
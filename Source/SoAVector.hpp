@@ -0,0 +1,242 @@
+﻿#pragma once
+#include <algorithm>
+#include <new>
+#include <span>
+#include <tuple>
+#include <utility>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+#include "SmallVector.hpp"
+
+namespace Snowy
+{
+/// <summary>
+/// Structure-of-arrays vector: every field lives in its own cache line aligned column, so a loop over one field
+/// only streams that field and can be vectorized over Column<I>().
+/// </summary>
+/// <typeparam name="Fields"> Column Types </typeparam>
+template<typename... Fields>
+class TSoAVector
+{
+    static_assert(sizeof...(Fields) > 0, "TSoAVector needs at least one field.");
+
+public:
+    static constexpr size_t FieldCount = sizeof...(Fields);
+    template<size_t I> using FieldType = std::tuple_element_t<I, std::tuple<Fields...>>;
+    static constexpr size_t ColumnAlignment = std::max({ g_CacheLineSize, alignof(Fields)... });
+
+private:
+    std::tuple<Fields*...> m_Columns{};
+    size_t m_Size = 0;
+    size_t m_Capacity = 0;
+
+public:
+    TSoAVector() = default;
+    explicit TSoAVector(size_t capacity) { Reserve(capacity); }
+    TSoAVector(const TSoAVector& other)
+    {
+        Reserve(other.m_Size);
+        try
+        {
+            ConstructColumns(m_Columns, 0, other.m_Size, [&]<size_t I>() {
+                std::uninitialized_copy_n(other.template Data<I>(), other.m_Size, Data<I>());
+            });
+        } catch (...)
+        {
+            // The destructor doesn't run for a constructor that threw.
+            Clear();
+            Free();
+            throw;
+        }
+        m_Size = other.m_Size;
+    }
+    TSoAVector(TSoAVector&& other) noexcept
+        : m_Columns(std::exchange(other.m_Columns, {}))
+        , m_Size(std::exchange(other.m_Size, 0))
+        , m_Capacity(std::exchange(other.m_Capacity, 0))
+    {}
+    ~TSoAVector()
+    {
+        Clear();
+        Free();
+    }
+    TSoAVector& operator=(TSoAVector other) noexcept
+    {
+        std::swap(m_Columns, other.m_Columns);
+        std::swap(m_Size, other.m_Size);
+        std::swap(m_Capacity, other.m_Capacity);
+        return *this;
+    }
+
+    size_t Size() const noexcept { return m_Size; }
+    size_t Capacity() const noexcept { return m_Capacity; }
+    bool Empty() const noexcept { return m_Size == 0; }
+
+    template<size_t I> FieldType<I>* Data() noexcept { return std::get<I>(m_Columns); }
+    template<size_t I> const FieldType<I>* Data() const noexcept { return std::get<I>(m_Columns); }
+
+    // Typed column views, aligned to ColumnAlignment.
+    template<size_t I> std::span<FieldType<I>> Column() noexcept { return { Data<I>(), m_Size }; }
+    template<size_t I> ArrayIn<FieldType<I>> Column() const noexcept { return { Data<I>(), m_Size }; }
+
+    template<size_t I> FieldType<I>& Get(size_t index) noexcept { SAssert(index < m_Size); return Data<I>()[index]; }
+    template<size_t I> const FieldType<I>& Get(size_t index) const noexcept { SAssert(index < m_Size); return Data<I>()[index]; }
+
+    template<typename... Args>
+    void EmplaceBack(Args&&... args)
+        requires (sizeof...(Args) == FieldCount)
+    {
+        auto values = std::forward_as_tuple(std::forward<Args>(args)...);
+        auto constructRow = [&](std::tuple<Fields*...>& columns) {
+            ConstructColumns(columns, m_Size, m_Size + 1, [&]<size_t I>() {
+                ::new (static_cast<void*>(std::get<I>(columns) + m_Size)) FieldType<I>(std::get<I>(std::move(values)));
+            });
+        };
+        if (m_Size == m_Capacity)
+        {
+            // Construct into the new columns first, args may refer to a row of the old ones.
+            size_t capacity = std::max(m_Size + 1, m_Capacity * 2);
+            std::tuple<Fields*...> columns = AllocateColumns(capacity);
+            try
+            {
+                constructRow(columns);
+            } catch (...)
+            {
+                FreeColumns(columns);
+                throw;
+            }
+            Adopt(columns, capacity);
+        } else
+        {
+            constructRow(m_Columns);
+        }
+        ++m_Size;
+    }
+    void PushBack(Fields... values) { EmplaceBack(std::move(values)...); }
+
+    void PopBack() noexcept
+    {
+        SAssert(m_Size != 0);
+        --m_Size;
+        ForEachColumn([&]<size_t I>() { std::destroy_at(Data<I>() + m_Size); });
+    }
+
+    /// <summary>
+    /// O(1) erase, moves the last row into index. Same contract as TSparseSet::Erase.
+    /// </summary>
+    void SwapErase(size_t index) noexcept
+    {
+        SAssert(index < m_Size);
+        if (index != m_Size - 1)
+        {
+            ForEachColumn([&]<size_t I>() { Data<I>()[index] = std::move(Data<I>()[m_Size - 1]); });
+        }
+        PopBack();
+    }
+
+    void Clear() noexcept
+    {
+        ForEachColumn([&]<size_t I>() { std::destroy_n(Data<I>(), m_Size); });
+        m_Size = 0;
+    }
+    void Reserve(size_t capacity)
+    {
+        if (capacity > m_Capacity)
+        {
+            Grow(capacity);
+        }
+    }
+    void Resize(size_t size)
+    {
+        Reserve(size);
+        if (size > m_Size)
+        {
+            ConstructColumns(m_Columns, m_Size, size, [&]<size_t I>() {
+                std::uninitialized_value_construct(Data<I>() + m_Size, Data<I>() + size);
+            });
+        } else
+        {
+            ForEachColumn([&]<size_t I>() { std::destroy(Data<I>() + size, Data<I>() + m_Size); });
+        }
+        m_Size = size;
+    }
+
+private:
+    template<typename Fn>
+    static void ForEachColumn(Fn&& fn)
+    {
+        [&]<size_t... I>(std::index_sequence<I...>) {
+            (fn.template operator()<I>(), ...);
+        }(std::index_sequence_for<Fields...>{});
+    }
+
+    // Run construct<I>(), which builds rows [first, last) of column I, for every column. If one throws, the columns
+    // already built are destroyed again in reverse, so either all columns get the rows or none does.
+    template<typename Fn>
+    static void ConstructColumns(std::tuple<Fields*...>& columns, size_t first, size_t last, Fn&& construct)
+    {
+        size_t built = 0;
+        try
+        {
+            ForEachColumn([&]<size_t I>() {
+                construct.template operator()<I>();
+                ++built;
+            });
+        } catch (...)
+        {
+            ForEachColumn([&]<size_t I>() {
+                constexpr size_t column = FieldCount - 1 - I;
+                if (column < built)
+                {
+                    std::destroy(std::get<column>(columns) + first, std::get<column>(columns) + last);
+                }
+            });
+            throw;
+        }
+    }
+
+    void Grow(size_t capacity)
+    {
+        Adopt(AllocateColumns(capacity), capacity);
+    }
+    static std::tuple<Fields*...> AllocateColumns(size_t capacity)
+    {
+        std::tuple<Fields*...> columns{};
+        try
+        {
+            ForEachColumn([&]<size_t I>() {
+                std::get<I>(columns) = static_cast<FieldType<I>*>(::operator new(capacity * sizeof(FieldType<I>), std::align_val_t(ColumnAlignment)));
+            });
+        } catch (...)
+        {
+            FreeColumns(columns);
+            throw;
+        }
+        return columns;
+    }
+    static void FreeColumns(std::tuple<Fields*...>& columns) noexcept
+    {
+        ForEachColumn([&]<size_t I>() {
+            if (std::get<I>(columns) != nullptr)
+            {
+                ::operator delete(std::get<I>(columns), std::align_val_t(ColumnAlignment));
+            }
+        });
+        columns = {};
+    }
+    // Relocate the rows into columns and release the old ones.
+    void Adopt(std::tuple<Fields*...> columns, size_t capacity) noexcept
+    {
+        ForEachColumn([&]<size_t I>() { RelocateN(Data<I>(), m_Size, std::get<I>(columns)); });
+        Free();
+        m_Columns = columns;
+        m_Capacity = capacity;
+    }
+    void Free() noexcept
+    {
+        FreeColumns(m_Columns);
+        m_Capacity = 0;
+    }
+};
+}
@@ -0,0 +1,96 @@
+﻿#pragma once
+#include <concepts>
+#include <vector>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+
+namespace Snowy
+{
+/// <summary>
+/// Sparse set of integer ids, O(1) insert, erase and contains, members packed densely for iteration.
+/// Erase moves the last member into the hole; mirror it in parallel arrays (e.g. TSoAVector::SwapErase) to keep them in step.
+/// </summary>
+/// <typeparam name="IndexT"> Unsigned Id Type </typeparam>
+template<std::unsigned_integral IndexT = uint32_t>
+class TSparseSet
+{
+public:
+    using IndexType = IndexT;
+    static constexpr IndexT InvalidIndex = static_cast<IndexT>(~IndexT(0));
+
+private:
+    std::vector<IndexT> m_Sparse;   // id -> dense slot, InvalidIndex if absent
+    std::vector<IndexT> m_Dense;    // dense slot -> id
+
+public:
+    TSparseSet() = default;
+    explicit TSparseSet(size_t maxId) { m_Sparse.reserve(maxId); }
+
+    bool Contains(IndexT id) const noexcept
+    {
+        return id < m_Sparse.size() && m_Sparse[id] != InvalidIndex;
+    }
+    // Dense slot of id, InvalidIndex if absent.
+    IndexT IndexOf(IndexT id) const noexcept
+    {
+        return id < m_Sparse.size() ? m_Sparse[id] : InvalidIndex;
+    }
+
+    /// <summary>
+    /// Returns false if id was already a member. New members are appended at dense slot Size() - 1.
+    /// </summary>
+    bool Insert(IndexT id)
+    {
+        SAssert(id != InvalidIndex);
+        if (id >= m_Sparse.size())
+        {
+            m_Sparse.resize(static_cast<size_t>(id) + 1, InvalidIndex);
+        } else if (m_Sparse[id] != InvalidIndex)
+        {
+            return false;
+        }
+        m_Sparse[id] = static_cast<IndexT>(m_Dense.size());
+        m_Dense.push_back(id);
+        return true;
+    }
+
+    /// <summary>
+    /// Returns the dense slot that was freed (and now holds the former last member), InvalidIndex if id was absent.
+    /// </summary>
+    IndexT Erase(IndexT id) noexcept
+    {
+        if (!Contains(id))
+        {
+            return InvalidIndex;
+        }
+        IndexT slot = m_Sparse[id];
+        IndexT last = m_Dense.back();
+        m_Dense[slot] = last;
+        m_Sparse[last] = slot;
+        m_Sparse[id] = InvalidIndex;
+        m_Dense.pop_back();
+        return slot;
+    }
+
+    void Clear() noexcept
+    {
+        for (IndexT id : m_Dense)
+        {
+            m_Sparse[id] = InvalidIndex;
+        }
+        m_Dense.clear();
+    }
+    void Reserve(size_t count) { m_Dense.reserve(count); }
+
+    size_t Size() const noexcept { return m_Dense.size(); }
+    bool Empty() const noexcept { return m_Dense.empty(); }
+    IndexT operator[](size_t slot) const noexcept { SAssert(slot < m_Dense.size()); return m_Dense[slot]; }
+
+    operator ArrayIn<IndexT>() const noexcept { return ArrayIn<IndexT>(m_Dense); }
+    ArrayIn<IndexT> Dense() const noexcept { return ArrayIn<IndexT>(m_Dense); }
+
+    const IndexT* begin() const noexcept { return m_Dense.data(); }
+    const IndexT* end() const noexcept { return m_Dense.data() + m_Dense.size(); }
+};
+}
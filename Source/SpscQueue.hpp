@@ -0,0 +1,262 @@
+﻿#pragma once
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <span>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+
+namespace Snowy
+{
+/// <summary>
+/// Bounded lock-free single-producer/single-consumer ring buffer.
+/// Each side keeps a cached copy of the other side's index, so the shared line is only read when the cache runs out.
+/// </summary>
+/// <typeparam name="T"> Element Type </typeparam>
+template<typename T>
+class TSpscQueue
+{
+public:
+    using ValueType = T;
+
+private:
+    // Spins before falling back to atomic wait in the blocking calls.
+    static constexpr int s_SpinCount = 64;
+
+    struct alignas(g_CacheLineSize) ProducerSide
+    {
+        std::atomic<size_t> Tail{ 0 };
+        size_t CachedHead = 0;
+    };
+    struct alignas(g_CacheLineSize) ConsumerSide
+    {
+        std::atomic<size_t> Head{ 0 };
+        size_t CachedTail = 0;
+    };
+    struct alignas(g_CacheLineSize) SleepState
+    {
+        std::atomic<bool> ProducerSleeping{ false };
+        std::atomic<bool> ConsumerSleeping{ false };
+    };
+
+    ProducerSide m_Producer;
+    ConsumerSide m_Consumer;
+    SleepState m_Sleep;
+    alignas(g_CacheLineSize) T* m_Slots;
+    size_t m_Mask;
+
+public:
+    /// <summary>
+    /// Capacity is rounded up to a power of two.
+    /// </summary>
+    explicit TSpscQueue(size_t capacity)
+        : m_Slots(std::allocator<T>().allocate(std::bit_ceil(capacity < 2 ? size_t(2) : capacity)))
+        , m_Mask(std::bit_ceil(capacity < 2 ? size_t(2) : capacity) - 1)
+    {}
+    TSpscQueue(const TSpscQueue&) = delete;
+    TSpscQueue& operator=(const TSpscQueue&) = delete;
+    ~TSpscQueue()
+    {
+        size_t tail = m_Producer.Tail.load(std::memory_order_relaxed);
+        for (size_t head = m_Consumer.Head.load(std::memory_order_relaxed); head != tail; ++head)
+        {
+            std::destroy_at(&m_Slots[head & m_Mask]);
+        }
+        std::allocator<T>().deallocate(m_Slots, m_Mask + 1);
+    }
+
+    size_t Capacity() const noexcept { return m_Mask + 1; }
+    // Approximate when called concurrently with the other side.
+    size_t Size() const noexcept
+    {
+        return m_Producer.Tail.load(std::memory_order_acquire) - m_Consumer.Head.load(std::memory_order_acquire);
+    }
+    bool Empty() const noexcept { return Size() == 0; }
+
+    // -------------------------------------------------------------
+    // Producer
+    // -------------------------------------------------------------
+
+    template<typename... Args>
+    bool TryEmplace(Args&&... args)
+    {
+        size_t tail = m_Producer.Tail.load(std::memory_order_relaxed);
+        if (FreeSlots(tail) == 0)
+        {
+            return false;
+        }
+        ::new (static_cast<void*>(&m_Slots[tail & m_Mask])) T(std::forward<Args>(args)...);
+        PublishTail(tail + 1);
+        return true;
+    }
+    bool TryPush(In<T> value) { return TryEmplace(value); }
+    bool TryPush(T&& value) { return TryEmplace(std::move(value)); }
+
+    /// <summary>
+    /// Copy as many items as fit, publish them with a single index store. Returns the count pushed.
+    /// </summary>
+    size_t PushN(ArrayIn<T> items)
+    {
+        size_t tail = m_Producer.Tail.load(std::memory_order_relaxed);
+        size_t count = std::min(items.size(), FreeSlots(tail));
+        for (size_t i = 0; i < count; ++i)
+        {
+            ::new (static_cast<void*>(&m_Slots[(tail + i) & m_Mask])) T(items[i]);
+        }
+        if (count != 0)
+        {
+            PublishTail(tail + count);
+        }
+        return count;
+    }
+
+    /// <summary>
+    /// Blocking push, spins briefly then sleeps on the consumer index until a slot frees up.
+    /// </summary>
+    template<typename... Args>
+    void Emplace(Args&&... args)
+    {
+        size_t tail = m_Producer.Tail.load(std::memory_order_relaxed);
+        while (FreeSlots(tail) == 0)
+        {
+            WaitWhileEqual(m_Consumer.Head, tail - Capacity(), m_Sleep.ProducerSleeping);
+        }
+        ::new (static_cast<void*>(&m_Slots[tail & m_Mask])) T(std::forward<Args>(args)...);
+        PublishTail(tail + 1);
+    }
+    void Push(In<T> value) { Emplace(value); }
+    void Push(T&& value) { Emplace(std::move(value)); }
+
+    // -------------------------------------------------------------
+    // Consumer
+    // -------------------------------------------------------------
+
+    bool TryPop(Ref<T> out)
+    {
+        size_t head = m_Consumer.Head.load(std::memory_order_relaxed);
+        if (UsedSlots(head) == 0)
+        {
+            return false;
+        }
+        T& slot = m_Slots[head & m_Mask];
+        out = std::move(slot);
+        std::destroy_at(&slot);
+        PublishHead(head + 1);
+        return true;
+    }
+
+    /// <summary>
+    /// Move up to out.size() items into out, release them with a single index store. Returns the count popped.
+    /// </summary>
+    size_t PopN(std::span<T> out)
+    {
+        size_t head = m_Consumer.Head.load(std::memory_order_relaxed);
+        size_t count = std::min(out.size(), UsedSlots(head));
+        for (size_t i = 0; i < count; ++i)
+        {
+            T& slot = m_Slots[(head + i) & m_Mask];
+            out[i] = std::move(slot);
+            std::destroy_at(&slot);
+        }
+        if (count != 0)
+        {
+            PublishHead(head + count);
+        }
+        return count;
+    }
+
+    /// <summary>
+    /// Blocking pop, spins briefly then sleeps on the producer index until an item arrives.
+    /// </summary>
+    T Pop()
+    {
+        size_t head = m_Consumer.Head.load(std::memory_order_relaxed);
+        while (UsedSlots(head) == 0)
+        {
+            WaitWhileEqual(m_Producer.Tail, head, m_Sleep.ConsumerSleeping);
+        }
+        T& slot = m_Slots[head & m_Mask];
+        T value = std::move(slot);
+        std::destroy_at(&slot);
+        PublishHead(head + 1);
+        return value;
+    }
+
+    /// <summary>
+    /// Blocking batch pop, waits until at least one item is available.
+    /// </summary>
+    size_t PopN(std::span<T> out, bool wait)
+    {
+        if (wait && !out.empty())
+        {
+            size_t head = m_Consumer.Head.load(std::memory_order_relaxed);
+            while (UsedSlots(head) == 0)
+            {
+                WaitWhileEqual(m_Producer.Tail, head, m_Sleep.ConsumerSleeping);
+            }
+        }
+        return PopN(out);
+    }
+
+private:
+    size_t FreeSlots(size_t tail) noexcept
+    {
+        size_t free = Capacity() - (tail - m_Producer.CachedHead);
+        if (free == 0)
+        {
+            m_Producer.CachedHead = m_Consumer.Head.load(std::memory_order_acquire);
+            free = Capacity() - (tail - m_Producer.CachedHead);
+        }
+        return free;
+    }
+    size_t UsedSlots(size_t head) noexcept
+    {
+        size_t used = m_Consumer.CachedTail - head;
+        if (used == 0)
+        {
+            m_Consumer.CachedTail = m_Producer.Tail.load(std::memory_order_acquire);
+            used = m_Consumer.CachedTail - head;
+        }
+        return used;
+    }
+
+    void PublishTail(size_t tail) noexcept
+    {
+        m_Producer.Tail.store(tail, std::memory_order_release);
+        // Only keeps the compiler from hoisting the flag load, the cpu barrier is paid by the side going to sleep:
+        // after its ProcessMemoryBarrier either we see the flag or it sees the new tail.
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        if (m_Sleep.ConsumerSleeping.load(std::memory_order_relaxed))
+        {
+            m_Producer.Tail.notify_one();
+        }
+    }
+    void PublishHead(size_t head) noexcept
+    {
+        m_Consumer.Head.store(head, std::memory_order_release);
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        if (m_Sleep.ProducerSleeping.load(std::memory_order_relaxed))
+        {
+            m_Consumer.Head.notify_one();
+        }
+    }
+
+    static void WaitWhileEqual(std::atomic<size_t>& index, size_t old, std::atomic<bool>& sleeping) noexcept
+    {
+        for (int i = 0; i < s_SpinCount; ++i)
+        {
+            if (index.load(std::memory_order_acquire) != old)
+            {
+                return;
+            }
+            Platform::CpuPause();
+        }
+        sleeping.store(true, std::memory_order_relaxed);
+        // Flushes the other side's store buffer too, so the publish path stays free of a full fence.
+        Platform::ProcessMemoryBarrier();
+        index.wait(old, std::memory_order_acquire);
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+};
+}
@@ -1,5 +1,10 @@
 ﻿#pragma once
+#include <algorithm>
+#include <compare>
+#include <span>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <filesystem>
 #include <unordered_map>
 
@@ -85,14 +90,15 @@ struct StringConvertor
     #define SSTR_TO_WIDE(x) x
     #define SSTR_TO_ANSI(x) Snowy::StringConvertor::WideToAnsi(x)
     #define SSTR_TO_UTF8(x) Snowy::StringConvertor::WideToUtf8(x)
-    #define PATH_TO_SSTR(x) x.wstring()
+    // A wide path already holds its native string, no conversion. Copied so the result never refers into x.
+    #define PATH_TO_SSTR(x) Snowy::SString((x).native())
 #else
     #define WIDE_TO_SSTR(x) Snowy::StringConvertor::WideToAnsi(x)
     #define ANSI_TO_SSTR(x) x
     #define SSTR_TO_WIDE(x) Snowy::StringConvertor::AnsiToWide(x)
     #define SSTR_TO_ANSI(x) x
     #define SSTR_TO_UTF8(x) Snowy::StringConvertor::AnsiToUtf8(x)
-    #define PATH_TO_SSTR(x) x.string()
+    #define PATH_TO_SSTR(x) (x).string()
 #endif // defined(SNOWY_CORE_CHAR_WIDE)
 
 /// <summary>
@@ -113,6 +119,318 @@ struct StringUtils
     }
 };
 
+/// <summary>
+/// Path operations on string views, without std::filesystem::path's allocations and conversions.
+/// Results are views into the input or into a caller buffer, convert once with ToNative when calling the OS.
+/// On Windows both '/' and '\' separate, a root is "C:", "C:\", "\" or "\\server\share", and comparison ignores ASCII case.
+/// </summary>
+template<IsChar CharT>
+struct TPathUtils
+{
+    using ViewType = std::basic_string_view<CharT>;
+
+#if defined(_WIN32)
+    static constexpr CharT PreferredSeparator = CharT('\\');
+    static constexpr bool IsSeparator(CharT c) noexcept { return c == CharT('/') || c == CharT('\\'); }
+#else
+    static constexpr CharT PreferredSeparator = CharT('/');
+    static constexpr bool IsSeparator(CharT c) noexcept { return c == CharT('/'); }
+#endif
+
+    /// <summary>
+    /// Length of the root: drive, leading separator or UNC share, 0 for a relative path.
+    /// </summary>
+    static constexpr size_t RootLength(ViewType path) noexcept
+    {
+    #if defined(_WIN32)
+        if (path.size() >= 2 && path[1] == CharT(':') && IsAsciiAlpha(path[0]))
+        {
+            return path.size() >= 3 && IsSeparator(path[2]) ? 3 : 2;
+        }
+        if (path.size() >= 3 && IsSeparator(path[0]) && IsSeparator(path[1]) && !IsSeparator(path[2]))
+        {
+            // \\server\share, the share belongs to the root.
+            size_t end = NextSeparator(path, NextSeparator(path, 2) + 1);
+            return std::min(end + 1, path.size());
+        }
+    #endif
+        return !path.empty() && IsSeparator(path[0]) ? 1 : 0;
+    }
+    static constexpr bool IsAbsolute(ViewType path) noexcept
+    {
+    #if defined(_WIN32)
+        // A drive with a separator or a UNC share, "\dir" is still relative to the current drive.
+        size_t root = RootLength(path);
+        return root >= 3 && (IsSeparator(path[root - 1]) || IsSeparator(path[1]));
+    #else
+        return RootLength(path) != 0;
+    #endif
+    }
+
+    /// <summary>
+    /// Last component, empty if the path ends with a separator.
+    /// </summary>
+    static constexpr ViewType FileName(ViewType path) noexcept
+    {
+        size_t root = RootLength(path);
+        size_t start = path.size();
+        while (start > root && !IsSeparator(path[start - 1]))
+        {
+            --start;
+        }
+        return path.substr(start);
+    }
+    /// <summary>
+    /// File name without its extension, "." and ".." and dot files like ".config" are all stem.
+    /// </summary>
+    static constexpr ViewType Stem(ViewType path) noexcept
+    {
+        ViewType name = FileName(path);
+        return name.substr(0, ExtensionOffset(name));
+    }
+    /// <summary>
+    /// Extension including the dot, empty if there is none.
+    /// </summary>
+    static constexpr ViewType Extension(ViewType path) noexcept
+    {
+        ViewType name = FileName(path);
+        return name.substr(ExtensionOffset(name));
+    }
+    /// <summary>
+    /// Path without its last component and the separators before it, the root stays.
+    /// </summary>
+    static constexpr ViewType Parent(ViewType path) noexcept
+    {
+        size_t root = RootLength(path);
+        size_t end = path.size();
+        while (end > root && !IsSeparator(path[end - 1]))
+        {
+            --end;
+        }
+        while (end > root && IsSeparator(path[end - 1]))
+        {
+            --end;
+        }
+        return path.substr(0, end);
+    }
+
+    /// <summary>
+    /// Lexically normalize into out: preferred separators, no repeated separators, "." dropped and ".." folded into the
+    /// component before it. Leading ".." of a relative path stay, ".." directly under a root is dropped, an empty result is ".".
+    /// The result is never longer than max(path.size(), 1), returns an empty view if out is too small.
+    /// </summary>
+    static constexpr ViewType Normalize(ViewType path, std::span<CharT> out) noexcept
+    {
+        size_t root = RootLength(path);
+        if (std::max<size_t>(path.size(), 1) > out.size())
+        {
+            return {};
+        }
+        size_t size = 0;
+        for (size_t i = 0; i < root; ++i)
+        {
+            out[size++] = IsSeparator(path[i]) ? PreferredSeparator : path[i];
+        }
+        const size_t base = size;
+        // Components in out after the root, and how many of them are leading ".." of a relative result which can't be folded.
+        size_t components = 0;
+        size_t keptParents = 0;
+        for (size_t start = root; start < path.size();)
+        {
+            size_t end = NextSeparator(path, start);
+            ViewType component = path.substr(start, end - start);
+            start = end + 1;
+            if (component.empty() || component == Dot())
+            {
+                continue;
+            }
+            if (component == DotDot())
+            {
+                if (components > keptParents)
+                {
+                    // Drop the last component and the separator before it.
+                    while (size > base && !IsSeparator(out[size - 1]))
+                    {
+                        --size;
+                    }
+                    if (size > base)
+                    {
+                        --size;
+                    }
+                    --components;
+                    continue;
+                }
+                if (base != 0 && IsSeparator(out[base - 1]))
+                {
+                    continue;
+                }
+                ++keptParents;
+            }
+            if (size > base)
+            {
+                out[size++] = PreferredSeparator;
+            }
+            for (CharT c : component)
+            {
+                out[size++] = c;
+            }
+            ++components;
+        }
+        if (size == 0)
+        {
+            out[size++] = CharT('.');
+        }
+        return ViewType(out.data(), size);
+    }
+
+    /// <summary>
+    /// Join relative onto base into out with one separator between, a relative path with a root replaces base.
+    /// Returns an empty view if out is too small.
+    /// </summary>
+    static constexpr ViewType Join(std::span<CharT> out, ViewType base, ViewType relative) noexcept
+    {
+        if (RootLength(relative) != 0 || base.empty())
+        {
+            return Copy(out, 0, relative);
+        }
+        bool separate = !relative.empty() && !IsSeparator(base.back()) && !IsDriveOnly(base);
+        size_t size = base.size() + (separate ? 1 : 0) + relative.size();
+        if (size > out.size())
+        {
+            return {};
+        }
+        Copy(out, 0, base);
+        if (separate)
+        {
+            out[base.size()] = PreferredSeparator;
+        }
+        Copy(out, size - relative.size(), relative);
+        return ViewType(out.data(), size);
+    }
+
+    /// <summary>
+    /// Roots compare exactly, then component-wise: any separator equals any other and past the root runs of them
+    /// count as one, so "\\server\share" and "\server\share" stay different. Case-insensitive for ASCII on Windows,
+    /// ordinal everywhere else.
+    /// </summary>
+    static constexpr std::weak_ordering Compare(ViewType lhs, ViewType rhs) noexcept
+    {
+        size_t lhsRoot = RootLength(lhs);
+        size_t rhsRoot = RootLength(rhs);
+        for (size_t k = 0; k < lhsRoot && k < rhsRoot; ++k)
+        {
+            if (OrderUnit(lhs[k]) != OrderUnit(rhs[k]))
+            {
+                return OrderUnit(lhs[k]) < OrderUnit(rhs[k]) ? std::weak_ordering::less : std::weak_ordering::greater;
+            }
+        }
+        if (lhsRoot != rhsRoot)
+        {
+            return lhsRoot <=> rhsRoot;
+        }
+
+        size_t i = SkipSeparators(lhs, lhsRoot);
+        size_t j = SkipSeparators(rhs, rhsRoot);
+        while (i < lhs.size() && j < rhs.size())
+        {
+            bool lhsSeparator = IsSeparator(lhs[i]);
+            bool rhsSeparator = IsSeparator(rhs[j]);
+            if (lhsSeparator && rhsSeparator)
+            {
+                i = SkipSeparators(lhs, i);
+                j = SkipSeparators(rhs, j);
+                continue;
+            }
+            auto a = OrderUnit(lhs[i]);
+            auto b = OrderUnit(rhs[j]);
+            if (a != b)
+            {
+                return a < b ? std::weak_ordering::less : std::weak_ordering::greater;
+            }
+            ++i;
+            ++j;
+        }
+        return (lhs.size() - i) <=> (rhs.size() - j);
+    }
+    static constexpr bool Equals(ViewType lhs, ViewType rhs) noexcept
+    {
+        return Compare(lhs, rhs) == 0;
+    }
+
+    /// <summary>
+    /// The single conversion at the OS boundary, a native-width view is copied without transcoding.
+    /// </summary>
+    static std::filesystem::path ToNative(ViewType path)
+    {
+        return std::filesystem::path(path);
+    }
+
+private:
+    static constexpr ViewType Dot() noexcept { return ViewType(s_Dots, 1); }
+    static constexpr ViewType DotDot() noexcept { return ViewType(s_Dots, 2); }
+    static constexpr CharT s_Dots[] = { CharT('.'), CharT('.'), CharT(0) };
+
+    static constexpr bool IsAsciiAlpha(CharT c) noexcept
+    {
+        return (c >= CharT('a') && c <= CharT('z')) || (c >= CharT('A') && c <= CharT('Z'));
+    }
+    static constexpr CharT FoldCase(CharT c) noexcept
+    {
+    #if defined(_WIN32)
+        return c >= CharT('A') && c <= CharT('Z') ? CharT(c - CharT('A') + CharT('a')) : c;
+    #else
+        return c;
+    #endif
+    }
+    // A separator sorts before any other character, so a parent sorts before its children.
+    static constexpr std::make_unsigned_t<CharT> OrderUnit(CharT c) noexcept
+    {
+        using Unit = std::make_unsigned_t<CharT>;
+        return IsSeparator(c) ? Unit(0) : Unit(FoldCase(c));
+    }
+    static constexpr bool IsDriveOnly(ViewType path) noexcept
+    {
+        size_t root = RootLength(path);
+        return root == path.size() && root != 0 && !IsSeparator(path[root - 1]);
+    }
+
+    static constexpr size_t NextSeparator(ViewType path, size_t start) noexcept
+    {
+        while (start < path.size() && !IsSeparator(path[start]))
+        {
+            ++start;
+        }
+        return start;
+    }
+    static constexpr size_t SkipSeparators(ViewType path, size_t start) noexcept
+    {
+        while (start < path.size() && IsSeparator(path[start]))
+        {
+            ++start;
+        }
+        return start;
+    }
+    static constexpr size_t ExtensionOffset(ViewType name) noexcept
+    {
+        size_t dot = name.rfind(CharT('.'));
+        return dot == ViewType::npos || dot == 0 || name == DotDot() ? name.size() : dot;
+    }
+
+    static constexpr ViewType Copy(std::span<CharT> out, size_t offset, ViewType text) noexcept
+    {
+        if (offset + text.size() > out.size())
+        {
+            return {};
+        }
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            out[offset + i] = text[i];
+        }
+        return ViewType(out.data(), offset + text.size());
+    }
+};
+using PathUtils = TPathUtils<SChar>;
+
 /// <summary>
 /// SnowyCore's custom string wrapper, which is proxy class for string, default is std::string or std::wstring.
 /// </summary>
@@ -0,0 +1,348 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+#include "ThreadPool.hpp"
+
+namespace Snowy
+{
+/// <summary>
+/// Per-node timing of the last TaskGraph::Run, all times in nanoseconds from the start of the run.
+/// </summary>
+struct TaskGraphNodeTiming
+{
+    AnsiStringView Name;
+    uint64_t Start = 0;
+    uint64_t End = 0;
+    uint64_t Duration = 0;
+    // Longest chain of node durations ending at this node, i.e. the earliest it could finish with unlimited workers.
+    uint64_t PathLength = 0;
+    // How much the node could grow before it lengthens the critical path.
+    uint64_t Slack = 0;
+    bool Critical = false;
+};
+
+/// <summary>
+/// Fixed DAG of jobs, declared once and run many times.
+/// Nodes and edges are added up front, Compile() flattens them, and every Run() only resets atomic dependency counters,
+/// so a run doesn't allocate. Ready nodes are scheduled on the pool, a finishing node keeps one ready successor for itself.
+/// </summary>
+class TaskGraph
+{
+public:
+    using NodeId = uint32_t;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct alignas(g_CacheLineSize) Node : ThreadJob
+    {
+        TaskGraph* Graph = nullptr;
+        std::function<void()> Fn;
+        AnsiString Name;
+        std::atomic<uint32_t> Pending{ 0 };
+        uint32_t DependencyCount = 0;
+        uint32_t FirstSuccessor = 0;
+        uint32_t SuccessorCount = 0;
+        Clock::time_point Start;
+        Clock::time_point End;
+
+        void Execute() noexcept override { Graph->RunNode(this); }
+    };
+
+    std::vector<UniqueHandle<Node>> m_Nodes;
+    std::vector<std::pair<NodeId, NodeId>> m_Edges;
+    // Compiled: successors of node i are m_Successors[FirstSuccessor, FirstSuccessor + SuccessorCount).
+    std::vector<NodeId> m_Successors;
+    std::vector<ThreadJob*> m_Roots;
+    std::vector<NodeId> m_TopoOrder;
+    bool m_Compiled = false;
+
+    ThreadPool* m_Pool = nullptr;
+    Clock::time_point m_RunStart;
+    std::exception_ptr m_Exception;
+    std::atomic<bool> m_Failed{ false };
+    alignas(g_CacheLineSize) std::atomic<uint32_t> m_Remaining{ 0 };
+    // Finishers between their m_Remaining decrement and their last touch of the graph, Run() waits them out.
+    std::atomic<uint32_t> m_Exiting{ 0 };
+
+    std::vector<TaskGraphNodeTiming> m_Timings;
+    std::vector<uint64_t> m_PathTails;      // longest path starting at each node, scratch for ComputeTimings
+    uint64_t m_CriticalPath = 0;
+    uint64_t m_WallTime = 0;
+
+public:
+    TaskGraph() = default;
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    NodeId AddNode(AnsiStringIn name, std::function<void()> fn)
+    {
+        auto node = MakeUnique<Node>();
+        node->Graph = this;
+        node->Name = AnsiString(name);
+        node->Fn = std::move(fn);
+        m_Nodes.push_back(std::move(node));
+        m_Compiled = false;
+        return static_cast<NodeId>(m_Nodes.size() - 1);
+    }
+
+    /// <summary>
+    /// after won't start before before has finished.
+    /// </summary>
+    void AddEdge(NodeId before, NodeId after)
+    {
+        SAssert(before < m_Nodes.size() && after < m_Nodes.size() && before != after);
+        m_Edges.emplace_back(before, after);
+        m_Compiled = false;
+    }
+
+    size_t NodeCount() const noexcept { return m_Nodes.size(); }
+
+    /// <summary>
+    /// Flatten the edges into successor lists and sort the nodes topologically. Returns false if the graph has a cycle.
+    /// Run() compiles on demand, call it explicitly to keep the first run allocation free too.
+    /// </summary>
+    bool Compile()
+    {
+        size_t count = m_Nodes.size();
+        std::vector<uint32_t> offsets(count + 1, 0);
+        for (auto& node : m_Nodes)
+        {
+            node->DependencyCount = 0;
+        }
+        for (auto [before, after] : m_Edges)
+        {
+            ++offsets[before + 1];
+            ++m_Nodes[after]->DependencyCount;
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            offsets[i + 1] += offsets[i];
+            m_Nodes[i]->FirstSuccessor = offsets[i];
+            m_Nodes[i]->SuccessorCount = 0;
+        }
+        m_Successors.assign(m_Edges.size(), 0);
+        for (auto [before, after] : m_Edges)
+        {
+            Node& node = *m_Nodes[before];
+            m_Successors[node.FirstSuccessor + node.SuccessorCount++] = after;
+        }
+
+        // Kahn's algorithm, also gives the order used for the critical path.
+        m_Roots.clear();
+        m_TopoOrder.clear();
+        m_TopoOrder.reserve(count);
+        std::vector<uint32_t> pending(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            pending[i] = m_Nodes[i]->DependencyCount;
+            if (pending[i] == 0)
+            {
+                m_Roots.push_back(m_Nodes[i].get());
+                m_TopoOrder.push_back(static_cast<NodeId>(i));
+            }
+        }
+        for (size_t head = 0; head < m_TopoOrder.size(); ++head)
+        {
+            const Node& node = *m_Nodes[m_TopoOrder[head]];
+            for (uint32_t s = 0; s < node.SuccessorCount; ++s)
+            {
+                NodeId successor = m_Successors[node.FirstSuccessor + s];
+                if (--pending[successor] == 0)
+                {
+                    m_TopoOrder.push_back(successor);
+                }
+            }
+        }
+        m_Timings.resize(count);
+        m_PathTails.resize(count);
+        m_Compiled = m_TopoOrder.size() == count;
+        return m_Compiled;
+    }
+
+    /// <summary>
+    /// Run the whole graph on pool and return when every node has finished. Not reentrant.
+    /// A worker calling this runs graph nodes itself while it waits. Rethrows the first exception thrown by a node.
+    /// Returns false without running anything if the edges form a cycle.
+    /// </summary>
+    [[nodiscard]] bool Run(ThreadPool& pool)
+    {
+        if (!m_Compiled && !Compile())
+        {
+            return false;
+        }
+        if (m_Nodes.empty())
+        {
+            return true;
+        }
+        m_Pool = &pool;
+        m_Exception = nullptr;
+        m_Failed.store(false, std::memory_order_relaxed);
+        for (auto& node : m_Nodes)
+        {
+            node->Pending.store(node->DependencyCount, std::memory_order_relaxed);
+        }
+        m_Remaining.store(static_cast<uint32_t>(m_Nodes.size()), std::memory_order_relaxed);
+        m_RunStart = Clock::now();
+        // Schedule publishes everything above to the workers.
+        pool.Schedule(ArrayIn<ThreadJob*>(m_Roots));
+
+        if (pool.CurrentWorkerIndex() >= 0)
+        {
+            while (m_Remaining.load(std::memory_order_acquire) != 0 && pool.TryRunOne())
+            {
+            }
+        }
+        for (uint32_t remaining = m_Remaining.load(std::memory_order_acquire); remaining != 0;
+             remaining = m_Remaining.load(std::memory_order_acquire))
+        {
+            m_Remaining.wait(remaining, std::memory_order_acquire);
+        }
+        // The last finisher may still be inside notify_all, the graph must outlive it.
+        while (m_Exiting.load(std::memory_order_acquire) != 0)
+        {
+            Platform::CpuPause();
+        }
+        m_WallTime = ToNanoseconds(Clock::now() - m_RunStart);
+        ComputeTimings();
+
+        if (m_Exception)
+        {
+            std::rethrow_exception(m_Exception);
+        }
+        return true;
+    }
+    [[nodiscard]] bool Run() { return Run(GlobalThreadPool::GetInstance()); }
+
+    // -------------------------------------------------------------
+    // Profiling, valid after Run()
+    // -------------------------------------------------------------
+
+    ArrayIn<TaskGraphNodeTiming> Timings() const noexcept { return m_Timings; }
+    // Longest dependent chain of measured node durations: the run time with unlimited workers.
+    uint64_t CriticalPathNanoseconds() const noexcept { return m_CriticalPath; }
+    uint64_t WallNanoseconds() const noexcept { return m_WallTime; }
+
+    /// <summary>
+    /// One line per node in topological order: duration, path length, slack, critical nodes marked with '*'.
+    /// </summary>
+    AnsiString CriticalPathReport() const
+    {
+        AnsiString report = "TaskGraph wall " + std::to_string(m_WallTime / 1000) + "us, critical path "
+            + std::to_string(m_CriticalPath / 1000) + "us\n";
+        for (NodeId id : m_TopoOrder)
+        {
+            const TaskGraphNodeTiming& timing = m_Timings[id];
+            report += timing.Critical ? "* " : "  ";
+            report += timing.Name;
+            report += " duration " + std::to_string(timing.Duration / 1000) + "us";
+            report += " path " + std::to_string(timing.PathLength / 1000) + "us";
+            report += " slack " + std::to_string(timing.Slack / 1000) + "us\n";
+        }
+        return report;
+    }
+
+private:
+    static uint64_t ToNanoseconds(Clock::duration duration) noexcept
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    }
+
+    void RunNode(Node* node) noexcept
+    {
+        while (node != nullptr)
+        {
+            node->Start = Clock::now();
+            try
+            {
+                node->Fn();
+            } catch (...)
+            {
+                if (!m_Failed.exchange(true, std::memory_order_acq_rel))
+                {
+                    m_Exception = std::current_exception();
+                }
+            }
+            node->End = Clock::now();
+
+            // Keep the first ready successor to run here, hand the rest to the pool.
+            Node* next = nullptr;
+            for (uint32_t s = 0; s < node->SuccessorCount; ++s)
+            {
+                Node* successor = m_Nodes[m_Successors[node->FirstSuccessor + s]].get();
+                if (successor->Pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    if (next == nullptr)
+                    {
+                        next = successor;
+                    } else
+                    {
+                        m_Pool->Schedule(successor);
+                    }
+                }
+            }
+            // Once m_Remaining hits zero Run() may return, so announce the exit before the decrement and leave after
+            // it. A non-null next keeps m_Remaining above zero, the graph stays alive for the loop.
+            m_Exiting.fetch_add(1, std::memory_order_relaxed);
+            if (m_Remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                m_Remaining.notify_all();
+            }
+            node = next;
+            m_Exiting.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    void ComputeTimings()
+    {
+        m_CriticalPath = 0;
+        for (NodeId id : m_TopoOrder)
+        {
+            const Node& node = *m_Nodes[id];
+            TaskGraphNodeTiming& timing = m_Timings[id];
+            timing.Name = node.Name;
+            timing.Start = ToNanoseconds(node.Start - m_RunStart);
+            timing.End = ToNanoseconds(node.End - m_RunStart);
+            timing.Duration = timing.End - timing.Start;
+            timing.PathLength = timing.Duration;
+            timing.Slack = 0;
+            timing.Critical = false;
+        }
+        // Forward pass: longest path ending at each node. Predecessors come first in topological order.
+        for (NodeId id : m_TopoOrder)
+        {
+            const Node& node = *m_Nodes[id];
+            uint64_t path = m_Timings[id].PathLength;
+            m_CriticalPath = std::max(m_CriticalPath, path);
+            for (uint32_t s = 0; s < node.SuccessorCount; ++s)
+            {
+                TaskGraphNodeTiming& successor = m_Timings[m_Successors[node.FirstSuccessor + s]];
+                successor.PathLength = std::max(successor.PathLength, path + successor.Duration);
+            }
+        }
+        // Backward pass: longest path starting at each node, slack is what's left of the critical path.
+        for (auto it = m_TopoOrder.rbegin(); it != m_TopoOrder.rend(); ++it)
+        {
+            const Node& node = *m_Nodes[*it];
+            uint64_t longest = 0;
+            for (uint32_t s = 0; s < node.SuccessorCount; ++s)
+            {
+                longest = std::max(longest, m_PathTails[m_Successors[node.FirstSuccessor + s]]);
+            }
+            TaskGraphNodeTiming& timing = m_Timings[*it];
+            m_PathTails[*it] = timing.Duration + longest;
+            uint64_t through = timing.PathLength + longest;
+            timing.Slack = m_CriticalPath - through;
+            timing.Critical = timing.Slack == 0;
+        }
+    }
+};
+}
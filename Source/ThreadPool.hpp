@@ -0,0 +1,553 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <exception>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+#include "Singleton.hpp"
+#include "MpmcQueue.hpp"
+
+namespace Snowy
+{
+/// <summary>
+/// Unit of work for ThreadPool. The pool never owns a job, whoever schedules it keeps it alive until Execute returns.
+/// </summary>
+class ThreadJob
+{
+public:
+    virtual void Execute() noexcept = 0;
+
+protected:
+    ~ThreadJob() = default;
+};
+
+/// <summary>
+/// Chase-Lev work-stealing deque. The owner pushes and pops at the bottom, any thread may steal from the top.
+/// Grown buffers are kept until destruction, so a thief never reads freed memory.
+/// </summary>
+/// <typeparam name="T"> Element Type, must be trivially copyable (usually a pointer) </typeparam>
+template<typename T>
+class TWorkStealingDeque
+{
+    static_assert(std::is_trivially_copyable_v<T>, "TWorkStealingDeque stores elements in atomics.");
+
+private:
+    struct Buffer
+    {
+        int64_t Mask;
+        UniqueHandle<std::atomic<T>[]> Items;
+
+        explicit Buffer(int64_t capacity) : Mask(capacity - 1), Items(new std::atomic<T>[static_cast<size_t>(capacity)]) {}
+        T Load(int64_t index) const noexcept { return Items[index & Mask].load(std::memory_order_relaxed); }
+        void Store(int64_t index, T value) noexcept { Items[index & Mask].store(value, std::memory_order_relaxed); }
+    };
+
+    alignas(g_CacheLineSize) std::atomic<int64_t> m_Top{ 0 };
+    alignas(g_CacheLineSize) std::atomic<int64_t> m_Bottom{ 0 };
+    std::atomic<Buffer*> m_Buffer;
+    std::vector<UniqueHandle<Buffer>> m_Buffers;    // owner only
+
+public:
+    explicit TWorkStealingDeque(size_t capacity = 256)
+    {
+        m_Buffers.push_back(MakeUnique<Buffer>(static_cast<int64_t>(std::bit_ceil(capacity < 2 ? size_t(2) : capacity))));
+        m_Buffer.store(m_Buffers.back().get(), std::memory_order_relaxed);
+    }
+    TWorkStealingDeque(const TWorkStealingDeque&) = delete;
+    TWorkStealingDeque& operator=(const TWorkStealingDeque&) = delete;
+
+    // Approximate when called concurrently.
+    size_t Size() const noexcept
+    {
+        int64_t size = m_Bottom.load(std::memory_order_relaxed) - m_Top.load(std::memory_order_relaxed);
+        return size > 0 ? static_cast<size_t>(size) : 0;
+    }
+    bool Empty() const noexcept { return Size() == 0; }
+
+    // Owner only.
+    void Push(T value)
+    {
+        int64_t bottom = m_Bottom.load(std::memory_order_relaxed);
+        int64_t top = m_Top.load(std::memory_order_acquire);
+        Buffer* buffer = m_Buffer.load(std::memory_order_relaxed);
+        if (bottom - top > buffer->Mask)
+        {
+            auto grown = MakeUnique<Buffer>((buffer->Mask + 1) * 2);
+            for (int64_t i = top; i < bottom; ++i)
+            {
+                grown->Store(i, buffer->Load(i));
+            }
+            buffer = grown.get();
+            m_Buffers.push_back(std::move(grown));
+            m_Buffer.store(buffer, std::memory_order_release);
+        }
+        buffer->Store(bottom, value);
+        m_Bottom.store(bottom + 1, std::memory_order_release);
+    }
+
+    // Owner only, LIFO.
+    bool Pop(Ref<T> out) noexcept
+    {
+        int64_t bottom = m_Bottom.load(std::memory_order_relaxed) - 1;
+        Buffer* buffer = m_Buffer.load(std::memory_order_relaxed);
+        m_Bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = m_Top.load(std::memory_order_relaxed);
+        if (top > bottom)
+        {
+            m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+        out = buffer->Load(bottom);
+        if (top == bottom)
+        {
+            // Last item, race the thieves for it.
+            bool won = m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // Any thread, FIFO. False if empty or lost a race.
+    bool Steal(Ref<T> out) noexcept
+    {
+        int64_t top = m_Top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = m_Bottom.load(std::memory_order_acquire);
+        if (top >= bottom)
+        {
+            return false;
+        }
+        Buffer* buffer = m_Buffer.load(std::memory_order_acquire);
+        T value = buffer->Load(top);
+        if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return false;
+        }
+        out = value;
+        return true;
+    }
+};
+
+class ThreadPool;
+
+namespace Detail
+{
+template<typename R>
+class TFutureState : public ThreadJob
+{
+public:
+    using ResultType = std::conditional_t<std::is_void_v<R>, std::monostate, R>;
+
+    std::atomic<uint32_t> Ready{ 0 };
+    std::atomic<uint32_t> RefCount{ 2 };    // one for the pool, one for the future
+    std::variant<std::monostate, ResultType, std::exception_ptr> Result;
+
+    void Release() noexcept
+    {
+        if (RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            Destroy();
+        }
+    }
+
+protected:
+    virtual void Destroy() noexcept = 0;
+
+    template<typename Fn>
+    void Complete(Fn& fn) noexcept
+    {
+        try
+        {
+            if constexpr (std::is_void_v<R>)
+            {
+                fn();
+                Result.template emplace<1>();
+            } else
+            {
+                Result.template emplace<1>(fn());
+            }
+        } catch (...)
+        {
+            Result.template emplace<2>(std::current_exception());
+        }
+        Ready.store(1, std::memory_order_release);
+        Ready.notify_all();
+        Release();
+    }
+};
+
+template<typename R, typename Fn>
+class TFutureJob final : public TFutureState<R>
+{
+public:
+    explicit TFutureJob(Fn&& fn) : m_Fn(std::move(fn)) {}
+    void Execute() noexcept override { this->Complete(m_Fn); }
+
+protected:
+    void Destroy() noexcept override { delete this; }
+
+private:
+    Fn m_Fn;
+};
+}
+
+/// <summary>
+/// Handle to the result of ThreadPool::Submit, one allocation shared with the job itself.
+/// Waiting from a pool worker runs other jobs instead of blocking the worker.
+/// </summary>
+/// <typeparam name="R"> Result Type </typeparam>
+template<typename R>
+class TTaskFuture
+{
+private:
+    Detail::TFutureState<R>* m_State = nullptr;
+
+public:
+    TTaskFuture() = default;
+    explicit TTaskFuture(Detail::TFutureState<R>* state) noexcept : m_State(state) {}
+    TTaskFuture(const TTaskFuture&) = delete;
+    TTaskFuture(TTaskFuture&& other) noexcept : m_State(std::exchange(other.m_State, nullptr)) {}
+    TTaskFuture& operator=(const TTaskFuture&) = delete;
+    TTaskFuture& operator=(TTaskFuture&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            m_State = std::exchange(other.m_State, nullptr);
+        }
+        return *this;
+    }
+    ~TTaskFuture() { Reset(); }
+
+    bool IsValid() const noexcept { return m_State != nullptr; }
+    bool IsReady() const noexcept { return m_State->Ready.load(std::memory_order_acquire) != 0; }
+
+    void Wait() const;
+
+    /// <summary>
+    /// Wait and take the result, rethrows if the job threw. Only call once.
+    /// </summary>
+    R Get()
+    {
+        Wait();
+        if (m_State->Result.index() == 2)
+        {
+            std::rethrow_exception(std::get<2>(m_State->Result));
+        }
+        if constexpr (!std::is_void_v<R>)
+        {
+            return std::move(std::get<1>(m_State->Result));
+        }
+    }
+
+    void Reset() noexcept
+    {
+        if (m_State != nullptr)
+        {
+            m_State->Release();
+            m_State = nullptr;
+        }
+    }
+};
+
+struct ThreadPoolDesc
+{
+    // 0 uses std::thread::hardware_concurrency().
+    uint32_t WorkerCount = 0;
+    // Pin worker i to logical core i.
+    bool PinWorkers = false;
+    // Capacity of the global injection queue used by non-worker threads.
+    size_t InjectionCapacity = 4096;
+};
+
+/// <summary>
+/// Work-stealing thread pool. Each worker owns a Chase-Lev deque, other threads submit through a global injection queue,
+/// idle workers steal from random victims and then park on an atomic wait until new work is signalled.
+/// </summary>
+class ThreadPool
+{
+private:
+    static constexpr int s_SpinCount = 128;
+
+    struct alignas(g_CacheLineSize) Worker
+    {
+        TWorkStealingDeque<ThreadJob*> Deque;
+        std::thread Thread;
+        uint32_t Seed = 0;
+    };
+    struct WorkerContext
+    {
+        ThreadPool* Pool = nullptr;
+        uint32_t Index = 0;
+    };
+    static WorkerContext& CurrentContext() noexcept
+    {
+        static thread_local WorkerContext s_Context;
+        return s_Context;
+    }
+
+    std::vector<UniqueHandle<Worker>> m_Workers;
+    TMpmcQueue<ThreadJob*> m_Injection;
+    alignas(g_CacheLineSize) std::atomic<uint32_t> m_WakeEvent{ 0 };
+    std::atomic<uint32_t> m_Sleepers{ 0 };
+    std::atomic<bool> m_Stopping{ false };
+
+public:
+    explicit ThreadPool(const ThreadPoolDesc& desc = {})
+        : m_Injection(desc.InjectionCapacity)
+    {
+        uint32_t count = desc.WorkerCount != 0 ? desc.WorkerCount : std::max(1u, std::thread::hardware_concurrency());
+        m_Workers.reserve(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            m_Workers.push_back(MakeUnique<Worker>());
+            m_Workers.back()->Seed = i * 0x9E3779B9u + 1;
+        }
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            m_Workers[i]->Thread = std::thread([this, i, pin = desc.PinWorkers] {
+                if (pin)
+                {
+                    Platform::PinCurrentThread(i);
+                }
+                WorkerLoop(i);
+            });
+        }
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    /// <summary>
+    /// Runs every job already scheduled, then joins the workers.
+    /// </summary>
+    ~ThreadPool()
+    {
+        m_Stopping.store(true, std::memory_order_seq_cst);
+        m_WakeEvent.fetch_add(1, std::memory_order_release);
+        m_WakeEvent.notify_all();
+        for (auto& worker : m_Workers)
+        {
+            worker->Thread.join();
+        }
+    }
+
+    uint32_t WorkerCount() const noexcept { return static_cast<uint32_t>(m_Workers.size()); }
+
+    // Index of the calling worker in this pool, -1 if the caller is not one of its workers.
+    int32_t CurrentWorkerIndex() const noexcept
+    {
+        const WorkerContext& context = CurrentContext();
+        return context.Pool == this ? static_cast<int32_t>(context.Index) : -1;
+    }
+    // The pool the calling thread works for, nullptr on non-worker threads.
+    static ThreadPool* Current() noexcept { return CurrentContext().Pool; }
+    // True when the calling worker's deque is empty, i.e. thieves took what it pushed. Always false off the pool.
+    bool IsLocalQueueEmpty() const noexcept
+    {
+        int32_t index = CurrentWorkerIndex();
+        return index >= 0 && m_Workers[index]->Deque.Empty();
+    }
+
+    /// <summary>
+    /// Schedule a caller-owned job. From a worker it goes to the worker's own deque, otherwise to the injection queue.
+    /// </summary>
+    void Schedule(ThreadJob* job)
+    {
+        int32_t index = CurrentWorkerIndex();
+        if (index >= 0)
+        {
+            m_Workers[index]->Deque.Push(job);
+        } else
+        {
+            m_Injection.Push(job);
+        }
+        Wake(1);
+    }
+
+    /// <summary>
+    /// Schedule a batch of caller-owned jobs and wake up to one worker per job.
+    /// </summary>
+    void Schedule(ArrayIn<ThreadJob*> jobs)
+    {
+        int32_t index = CurrentWorkerIndex();
+        if (index >= 0)
+        {
+            for (ThreadJob* job : jobs)
+            {
+                m_Workers[index]->Deque.Push(job);
+            }
+        } else
+        {
+            for (size_t pushed = 0; pushed < jobs.size();)
+            {
+                size_t count = m_Injection.PushN(jobs.subspan(pushed));
+                if (count == 0)
+                {
+                    m_Injection.Push(jobs[pushed]);
+                    count = 1;
+                }
+                pushed += count;
+            }
+        }
+        Wake(static_cast<uint32_t>(jobs.size()));
+    }
+
+    /// <summary>
+    /// Run fn on the pool. The returned future shares a single allocation with the job.
+    /// </summary>
+    template<typename Fn>
+    auto Submit(Fn&& fn) -> TTaskFuture<std::invoke_result_t<std::decay_t<Fn>&>>
+    {
+        using R = std::invoke_result_t<std::decay_t<Fn>&>;
+        auto* job = new Detail::TFutureJob<R, std::decay_t<Fn>>(std::decay_t<Fn>(std::forward<Fn>(fn)));
+        Schedule(job);
+        return TTaskFuture<R>(job);
+    }
+
+    /// <summary>
+    /// Run one pending job on the calling thread if any can be found. Used to help while waiting.
+    /// </summary>
+    bool TryRunOne()
+    {
+        ThreadJob* job = FindJob(CurrentWorkerIndex());
+        if (job == nullptr)
+        {
+            return false;
+        }
+        job->Execute();
+        return true;
+    }
+
+private:
+    void Wake(uint32_t count) noexcept
+    {
+        // Pairs with the Sleepers increment in Park.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint32_t sleepers = m_Sleepers.load(std::memory_order_relaxed);
+        if (sleepers == 0)
+        {
+            return;
+        }
+        m_WakeEvent.fetch_add(1, std::memory_order_release);
+        if (count >= sleepers)
+        {
+            m_WakeEvent.notify_all();
+        } else
+        {
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                m_WakeEvent.notify_one();
+            }
+        }
+    }
+
+    ThreadJob* FindJob(int32_t self)
+    {
+        ThreadJob* job = nullptr;
+        if (self >= 0 && m_Workers[self]->Deque.Pop(job))
+        {
+            return job;
+        }
+        if (m_Injection.TryPop(job))
+        {
+            return job;
+        }
+        // Steal starting at a random victim.
+        uint32_t count = WorkerCount();
+        uint32_t start = self >= 0 ? NextRandom(*m_Workers[self]) % count : 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            uint32_t victim = (start + i) % count;
+            if (static_cast<int32_t>(victim) != self && m_Workers[victim]->Deque.Steal(job))
+            {
+                return job;
+            }
+        }
+        return nullptr;
+    }
+
+    static uint32_t NextRandom(Worker& worker) noexcept
+    {
+        // xorshift32
+        uint32_t x = worker.Seed;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        worker.Seed = x;
+        return x;
+    }
+
+    void WorkerLoop(uint32_t index)
+    {
+        CurrentContext() = { this, index };
+        int idle = 0;
+        for (;;)
+        {
+            if (ThreadJob* job = FindJob(static_cast<int32_t>(index)))
+            {
+                job->Execute();
+                idle = 0;
+                continue;
+            }
+            if (++idle < s_SpinCount)
+            {
+                Platform::CpuPause();
+                continue;
+            }
+            idle = 0;
+
+            uint32_t event = m_WakeEvent.load(std::memory_order_acquire);
+            m_Sleepers.fetch_add(1, std::memory_order_seq_cst);
+            ThreadJob* job = FindJob(static_cast<int32_t>(index));
+            if (job == nullptr)
+            {
+                if (m_Stopping.load(std::memory_order_acquire))
+                {
+                    m_Sleepers.fetch_sub(1, std::memory_order_relaxed);
+                    break;
+                }
+                m_WakeEvent.wait(event, std::memory_order_acquire);
+            }
+            m_Sleepers.fetch_sub(1, std::memory_order_relaxed);
+            if (job != nullptr)
+            {
+                job->Execute();
+            }
+        }
+        CurrentContext() = {};
+    }
+};
+
+template<typename R>
+void TTaskFuture<R>::Wait() const
+{
+    SAssert(m_State != nullptr);
+    // On a worker, keep the worker busy with other jobs until ours is done.
+    if (ThreadPool* pool = ThreadPool::Current())
+    {
+        while (!IsReady() && pool->TryRunOne())
+        {
+        }
+    }
+    m_State->Ready.wait(0, std::memory_order_acquire);
+}
+
+/// <summary>
+/// Process wide pool, sized to the hardware.
+/// </summary>
+class GlobalThreadPool : public ThreadPool, public TSingleton<GlobalThreadPool>
+{
+    friend class TSingleton<GlobalThreadPool>;
+
+protected:
+    GlobalThreadPool() = default;
+};
+}
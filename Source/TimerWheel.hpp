@@ -0,0 +1,469 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Typedef.hpp"
+#include "Misc.hpp"
+#include "ThreadPool.hpp"
+
+namespace Snowy
+{
+struct TimerWheelDesc
+{
+    // Wheel resolution, timers fire at the first tick at or after their deadline.
+    std::chrono::nanoseconds Tick = std::chrono::microseconds(1);
+    // When the next deadline is this close the timer thread spins instead of sleeping, 0 always sleeps.
+    std::chrono::nanoseconds SpinWindow = std::chrono::nanoseconds(0);
+    // Run callbacks on this pool, nullptr runs them on the timer thread.
+    ThreadPool* Pool = nullptr;
+};
+
+/// <summary>
+/// Identifies a scheduled timer, stays safe to cancel after the timer fired and its slot was reused.
+/// </summary>
+struct TimerHandle
+{
+    uint32_t Index = UINT32_MAX;
+    uint32_t Generation = 0;
+
+    bool IsValid() const noexcept { return Index != UINT32_MAX; }
+};
+
+/// <summary>
+/// Hierarchical timer wheel: 6 levels of 256 slots, level l holding timers due within 256^(l+1) ticks.
+/// Schedule and Cancel are O(1) list operations, a level's slot is redistributed to the level below when time reaches it.
+/// A dedicated thread sleeps until the next occupied slot (found through per-level occupancy bitmaps) and fires callbacks.
+/// </summary>
+class TimerWheel
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr uint32_t s_Nil = UINT32_MAX;
+    static constexpr uint32_t s_LevelBits = 8;
+    static constexpr uint32_t s_SlotCount = 1u << s_LevelBits;
+    static constexpr uint32_t s_LevelCount = 6;
+    static constexpr uint64_t s_MaxDelay = (uint64_t(1) << (s_LevelBits * s_LevelCount)) - 1;
+    static constexpr uint64_t s_NoEvent = UINT64_MAX;
+
+    enum class ETimerState : uint8_t { Free, Pending, Firing };
+
+    struct Node : ThreadJob
+    {
+        TimerWheel* Wheel = nullptr;
+        std::function<void()> Fn;
+        uint64_t Expiry = 0;
+        uint64_t Period = 0;
+        uint32_t Index = 0;
+        uint32_t Prev = s_Nil;
+        uint32_t Next = s_Nil;
+        uint32_t Generation = 0;
+        uint8_t Level = 0;
+        uint8_t Slot = 0;
+        ETimerState State = ETimerState::Free;
+        bool Cancelled = false;
+
+        void Execute() noexcept override { Wheel->RunCallback(*this); }
+    };
+
+    struct Level
+    {
+        uint32_t Heads[s_SlotCount];
+        uint64_t Occupied[s_SlotCount / 64]{};
+    };
+
+    Clock::time_point m_Start;
+    uint64_t m_TickNs;
+    Clock::duration m_SpinWindow;
+    ThreadPool* m_Pool;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_WakeUp;
+    std::deque<Node> m_Nodes;           // deque keeps nodes in place while callbacks run unlocked
+    uint32_t m_FreeList = s_Nil;
+    Level m_Levels[s_LevelCount];
+    uint64_t m_Now = 0;                 // last processed tick
+    uint64_t m_PlannedTick = s_NoEvent; // tick the timer thread is sleeping towards
+    size_t m_PendingCount = 0;
+    // Resolved under the lock: m_Nodes[index] reads the deque's block map, which Schedule may grow concurrently.
+    std::vector<Node*> m_Expired;
+    std::vector<Node*> m_Firing;
+    bool m_Stopping = false;
+    std::atomic<uint32_t> m_InFlight{ 0 };  // callbacks handed to the pool
+    std::atomic<uint32_t> m_Exiting{ 0 };   // pooled callbacks between their m_InFlight decrement and their last access
+    std::thread m_Thread;
+
+public:
+    explicit TimerWheel(const TimerWheelDesc& desc = {})
+        : m_Start(Clock::now())
+        , m_TickNs(std::max<uint64_t>(1, static_cast<uint64_t>(desc.Tick.count())))
+        , m_SpinWindow(std::chrono::duration_cast<Clock::duration>(desc.SpinWindow))
+        , m_Pool(desc.Pool)
+    {
+        for (Level& level : m_Levels)
+        {
+            std::fill(std::begin(level.Heads), std::end(level.Heads), s_Nil);
+        }
+        m_Thread = std::thread([this] { ThreadLoop(); });
+    }
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+    /// <summary>
+    /// Pending timers are dropped without firing, callbacks already running are waited for.
+    /// </summary>
+    ~TimerWheel()
+    {
+        {
+            std::lock_guard lock(m_Mutex);
+            m_Stopping = true;
+        }
+        m_WakeUp.notify_one();
+        m_Thread.join();
+        for (uint32_t inFlight = m_InFlight.load(std::memory_order_acquire); inFlight != 0;
+             inFlight = m_InFlight.load(std::memory_order_acquire))
+        {
+            m_InFlight.wait(inFlight, std::memory_order_acquire);
+        }
+        while (m_Exiting.load(std::memory_order_acquire) != 0)
+        {
+            Platform::CpuPause();
+        }
+    }
+
+    /// <summary>
+    /// Call fn once after delay, then every period if period is non-zero.
+    /// </summary>
+    TimerHandle Schedule(std::chrono::nanoseconds delay, std::function<void()> fn, std::chrono::nanoseconds period = {})
+    {
+        uint64_t delayTicks = ToTicksCeil(delay);
+        std::unique_lock lock(m_Mutex);
+        uint32_t index = AllocateNode();
+        Node& node = m_Nodes[index];
+        node.Fn = std::move(fn);
+        node.Period = period.count() > 0 ? std::max<uint64_t>(1, ToTicksCeil(period)) : 0;
+        node.Expiry = std::max(CurrentTick() + delayTicks, m_Now + 1);
+        node.State = ETimerState::Pending;
+        node.Cancelled = false;
+        Insert(node);
+        ++m_PendingCount;
+        bool earlier = node.Expiry < m_PlannedTick;
+        TimerHandle handle{ index, node.Generation };
+        if (earlier)
+        {
+            m_PlannedTick = node.Expiry;
+            lock.unlock();
+            m_WakeUp.notify_one();
+        }
+        return handle;
+    }
+
+    /// <summary>
+    /// Returns true if the timer was pending and will not fire. A callback already running finishes,
+    /// but a periodic timer isn't re-armed afterwards.
+    /// </summary>
+    bool Cancel(TimerHandle handle)
+    {
+        std::lock_guard lock(m_Mutex);
+        if (handle.Index >= m_Nodes.size())
+        {
+            return false;
+        }
+        Node& node = m_Nodes[handle.Index];
+        if (node.Generation != handle.Generation || node.State == ETimerState::Free)
+        {
+            return false;
+        }
+        if (node.State == ETimerState::Firing)
+        {
+            node.Cancelled = true;
+            return false;
+        }
+        Unlink(node);
+        --m_PendingCount;
+        FreeNode(node);
+        return true;
+    }
+
+    size_t PendingCount()
+    {
+        std::lock_guard lock(m_Mutex);
+        return m_PendingCount;
+    }
+
+private:
+    uint64_t ToTicksCeil(std::chrono::nanoseconds duration) const noexcept
+    {
+        uint64_t ns = duration.count() > 0 ? static_cast<uint64_t>(duration.count()) : 0;
+        return (ns + m_TickNs - 1) / m_TickNs;
+    }
+    uint64_t CurrentTick() const noexcept
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_Start).count()) / m_TickNs;
+    }
+    Clock::time_point TimeOfTick(uint64_t tick) const noexcept
+    {
+        return m_Start + std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(tick * m_TickNs));
+    }
+
+    // -------------------------------------------------------------
+    // Node Storage
+    // -------------------------------------------------------------
+
+    uint32_t AllocateNode()
+    {
+        if (m_FreeList != s_Nil)
+        {
+            uint32_t index = m_FreeList;
+            m_FreeList = m_Nodes[index].Next;
+            return index;
+        }
+        Node& node = m_Nodes.emplace_back();
+        node.Wheel = this;
+        node.Index = static_cast<uint32_t>(m_Nodes.size() - 1);
+        return node.Index;
+    }
+    void FreeNode(Node& node)
+    {
+        node.Fn = nullptr;
+        node.State = ETimerState::Free;
+        ++node.Generation;
+        node.Next = m_FreeList;
+        m_FreeList = node.Index;
+    }
+
+    // -------------------------------------------------------------
+    // Wheel
+    // -------------------------------------------------------------
+
+    void Insert(Node& node)
+    {
+        SAssert(node.Expiry >= m_Now);
+        if (node.Expiry - m_Now > s_MaxDelay)
+        {
+            node.Expiry = m_Now + s_MaxDelay;
+        }
+        uint64_t delta = node.Expiry - m_Now;
+        uint32_t level = delta == 0 ? 0 : static_cast<uint32_t>(std::bit_width(delta) - 1) / s_LevelBits;
+        uint32_t slot = static_cast<uint32_t>(node.Expiry >> (level * s_LevelBits)) & (s_SlotCount - 1);
+        Level& wheel = m_Levels[level];
+        node.Level = static_cast<uint8_t>(level);
+        node.Slot = static_cast<uint8_t>(slot);
+        node.Prev = s_Nil;
+        node.Next = wheel.Heads[slot];
+        if (node.Next != s_Nil)
+        {
+            m_Nodes[node.Next].Prev = node.Index;
+        }
+        wheel.Heads[slot] = node.Index;
+        wheel.Occupied[slot / 64] |= uint64_t(1) << (slot % 64);
+    }
+    void Unlink(Node& node)
+    {
+        Level& wheel = m_Levels[node.Level];
+        if (node.Prev != s_Nil)
+        {
+            m_Nodes[node.Prev].Next = node.Next;
+        } else
+        {
+            wheel.Heads[node.Slot] = node.Next;
+            if (node.Next == s_Nil)
+            {
+                wheel.Occupied[node.Slot / 64] &= ~(uint64_t(1) << (node.Slot % 64));
+            }
+        }
+        if (node.Next != s_Nil)
+        {
+            m_Nodes[node.Next].Prev = node.Prev;
+        }
+    }
+    // Take the whole list of a slot.
+    uint32_t DetachSlot(uint32_t level, uint32_t slot)
+    {
+        Level& wheel = m_Levels[level];
+        uint32_t head = std::exchange(wheel.Heads[slot], s_Nil);
+        wheel.Occupied[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+        return head;
+    }
+
+    // First occupied slot at or after from, s_SlotCount if none.
+    static uint32_t FindOccupied(const Level& level, uint32_t from) noexcept
+    {
+        for (uint32_t word = from / 64; word < s_SlotCount / 64; ++word)
+        {
+            uint64_t bits = level.Occupied[word];
+            if (word == from / 64)
+            {
+                bits &= ~uint64_t(0) << (from % 64);
+            }
+            if (bits != 0)
+            {
+                return word * 64 + static_cast<uint32_t>(std::countr_zero(bits));
+            }
+        }
+        return s_SlotCount;
+    }
+
+    // Next tick after m_Now at which a slot fires (level 0) or is redistributed (higher levels).
+    uint64_t NextEventTick() const noexcept
+    {
+        uint64_t best = s_NoEvent;
+        for (uint32_t l = 0; l < s_LevelCount; ++l)
+        {
+            uint32_t shift = l * s_LevelBits;
+            uint64_t rotation = uint64_t(1) << (shift + s_LevelBits);
+            uint64_t base = m_Now & ~(rotation - 1);
+            uint32_t current = static_cast<uint32_t>(m_Now >> shift) & (s_SlotCount - 1);
+            uint32_t slot = current + 1 < s_SlotCount ? FindOccupied(m_Levels[l], current + 1) : s_SlotCount;
+            if (slot == s_SlotCount)
+            {
+                // Wrap around into the next rotation.
+                slot = FindOccupied(m_Levels[l], 0);
+                if (slot > current)
+                {
+                    continue;
+                }
+                base += rotation;
+            }
+            best = std::min(best, base + (uint64_t(slot) << shift));
+        }
+        return best;
+    }
+
+    // Process every event up to target, expired timers end up in m_Expired.
+    void Advance(uint64_t target)
+    {
+        for (;;)
+        {
+            uint64_t next = NextEventTick();
+            if (next > target)
+            {
+                m_Now = std::max(m_Now, target);
+                return;
+            }
+            m_Now = next;
+            // Redistribute from the top, so timers moving down can cascade again at the same tick.
+            for (uint32_t l = s_LevelCount - 1; l >= 1; --l)
+            {
+                uint32_t shift = l * s_LevelBits;
+                if ((m_Now & ((uint64_t(1) << shift) - 1)) != 0)
+                {
+                    continue;
+                }
+                uint32_t index = DetachSlot(l, static_cast<uint32_t>(m_Now >> shift) & (s_SlotCount - 1));
+                while (index != s_Nil)
+                {
+                    Node& node = m_Nodes[index];
+                    index = node.Next;
+                    Insert(node);
+                }
+            }
+            uint32_t index = DetachSlot(0, static_cast<uint32_t>(m_Now) & (s_SlotCount - 1));
+            while (index != s_Nil)
+            {
+                Node& node = m_Nodes[index];
+                index = node.Next;
+                node.State = ETimerState::Firing;
+                --m_PendingCount;
+                m_Expired.push_back(&node);
+            }
+        }
+    }
+
+    // -------------------------------------------------------------
+    // Firing
+    // -------------------------------------------------------------
+
+    void ThreadLoop()
+    {
+        std::unique_lock lock(m_Mutex);
+        while (!m_Stopping)
+        {
+            Advance(CurrentTick());
+            if (!m_Expired.empty())
+            {
+                std::swap(m_Expired, m_Firing);
+                lock.unlock();
+                for (Node* node : m_Firing)
+                {
+                    if (m_Pool != nullptr)
+                    {
+                        m_InFlight.fetch_add(1, std::memory_order_relaxed);
+                        m_Pool->Schedule(node);
+                    } else
+                    {
+                        RunCallback(*node);
+                    }
+                }
+                m_Firing.clear();
+                lock.lock();
+                continue;
+            }
+
+            uint64_t next = NextEventTick();
+            m_PlannedTick = next;
+            if (next == s_NoEvent)
+            {
+                m_WakeUp.wait(lock);
+                continue;
+            }
+            Clock::time_point deadline = TimeOfTick(next);
+            if (deadline - Clock::now() > m_SpinWindow)
+            {
+                m_WakeUp.wait_until(lock, deadline - m_SpinWindow);
+                continue;
+            }
+            lock.unlock();
+            while (Clock::now() < deadline)
+            {
+                Platform::CpuPause();
+            }
+            lock.lock();
+        }
+        m_PlannedTick = s_NoEvent;
+    }
+
+    // Runs unlocked on the timer thread or a pool worker, then re-arms or frees the node.
+    void RunCallback(Node& node) noexcept
+    {
+        node.Fn();
+        bool pooled = m_Pool != nullptr;
+        {
+            std::lock_guard lock(m_Mutex);
+            if (node.Period != 0 && !node.Cancelled && !m_Stopping)
+            {
+                node.Expiry = std::max(node.Expiry + node.Period, m_Now + 1);
+                node.State = ETimerState::Pending;
+                Insert(node);
+                ++m_PendingCount;
+                if (node.Expiry < m_PlannedTick)
+                {
+                    m_PlannedTick = node.Expiry;
+                    m_WakeUp.notify_one();
+                }
+            } else
+            {
+                FreeNode(node);
+            }
+        }
+        if (pooled)
+        {
+            // The destructor may return once m_InFlight hits zero, leaving m_Exiting is the last access to the wheel.
+            m_Exiting.fetch_add(1, std::memory_order_relaxed);
+            if (m_InFlight.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                m_InFlight.notify_all();
+            }
+            m_Exiting.fetch_sub(1, std::memory_order_release);
+        }
+    }
+};
+}
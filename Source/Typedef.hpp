@@ -63,6 +63,14 @@ template<typename T, typename... Args>
 inline constexpr ObserverHandle<T> MakeObserver(Args&&... args) { return ObserverHandle<T>(std::forward<Args>(args)...); }
 
 
+// -------------------------------------------------------------
+// Memory Define
+// -------------------------------------------------------------
+
+// Alignment used to keep data written by different threads on separate cache lines.
+constexpr inline size_t g_CacheLineSize = 64;
+
+
 // -------------------------------------------------------------
 // String Type Define
 // -------------------------------------------------------------